@@ -0,0 +1,202 @@
+// ****** Small-buffer delegate (callable wrapper). (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_DELEGATE_H_
+#define _LIS_DELEGATE_H_
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+const size_t DelegateInlineSize = 4 * sizeof(void*); // object + member function pointer, small lambdas
+
+template <typename TSignature>
+class Delegate;
+
+// ** std::function replacement keeping the callables up to DelegateInlineSize bytes (nothrow movable)
+// inside the object: no allocation for the member function + object (Delegate(obj, &Class::Method),
+// std::bind of it) or the lambdas capturing a few pointers; the larger callables are allocated as by
+// std::function. The trivially copyable callables are copied without the indirect call.
+// Constructed from any callable as std::function (empty function pointer / std::function - empty delegate),
+// the call of the empty delegate throws std::bad_function_call.
+template <typename TResult, typename... TArgs>
+class Delegate<TResult(TArgs...)>
+{
+	enum ManageOp { moCopy, moMove, moDestroy };
+	typedef TResult InvokeFunc(void* storage, TArgs&&... args);
+	typedef void ManageFunc(ManageOp op, void* dst, void* src);
+
+	alignas(std::max_align_t) unsigned char storage[DelegateInlineSize];
+	InvokeFunc* invoker;
+	ManageFunc* manager; // nullptr - the inline callable is trivially copyable (or the delegate is empty)
+
+	template <typename F>
+	struct IsInline : std::integral_constant<bool, sizeof(F) <= DelegateInlineSize
+		&& alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value> { };
+
+	template <typename F>
+	struct IsTrivial : std::integral_constant<bool, IsInline<F>::value
+		&& std::is_trivially_copy_constructible<F>::value && std::is_trivially_destructible<F>::value> { };
+
+	template <typename F, typename = void>
+	struct IsCallable : std::false_type { };
+	template <typename F>
+	struct IsCallable<F, typename std::enable_if<std::is_void<TResult>::value
+		|| std::is_convertible<decltype(std::declval<F&>()(std::declval<TArgs>()...)), TResult>::value>::type>
+		: std::true_type { };
+
+	template <typename F>
+	static bool IsNull(const F&) { return false; }
+	template <typename R, typename... A>
+	static bool IsNull(R (*func)(A...)) { return nullptr == func; }
+	template <typename S>
+	static bool IsNull(const std::function<S>& func) { return !func; }
+
+	template <typename F>
+	static F* Target(void* src, std::true_type) { return (F*)src; }
+	template <typename F>
+	static F* Target(void* src, std::false_type) { return *(F**)src; }
+
+	template <typename F>
+	static TResult Invoke(void* src, TArgs&&... args) {
+		return (*Target<F>(src, IsInline<F>()))(std::forward<TArgs>(args)...);
+	}
+
+	template <typename F>
+	static void ManageItem(ManageOp op, void* dst, void* src, std::true_type) {
+		switch (op) {
+		case moCopy: new (dst) F(*(F*)src); break;
+		case moMove: new (dst) F(std::move(*(F*)src)); ((F*)src)->~F(); break;
+		default: ((F*)dst)->~F();
+		}
+	}
+	template <typename F>
+	static void ManageItem(ManageOp op, void* dst, void* src, std::false_type) {
+		switch (op) {
+		case moCopy: *(F**)dst = new F(**(F**)src); break;
+		case moMove: *(F**)dst = *(F**)src; break;
+		default: delete *(F**)dst;
+		}
+	}
+	template <typename F>
+	static void Manage(ManageOp op, void* dst, void* src) { ManageItem<F>(op, dst, src, IsInline<F>()); }
+
+	template <typename F, typename T>
+	void Construct(T&& func, std::true_type) { // the tail is cleared: the trivial callables are copied whole
+		new (storage) F(std::forward<T>(func));
+		std::memset(storage + sizeof(F), 0, sizeof(storage) - sizeof(F));
+	}
+	template <typename F, typename T>
+	void Construct(T&& func, std::false_type) { *(F**)storage = new F(std::forward<T>(func)); }
+
+	template <typename F>
+	void Assign(F&& func) {
+		typedef typename std::decay<F>::type Func;
+		if (IsNull(func)) return;
+		Construct<Func>(std::forward<F>(func), IsInline<Func>());
+		invoker = &Invoke<Func>;
+		manager = IsTrivial<Func>::value ? nullptr : &Manage<Func>;
+	}
+
+	void CopyFrom(const Delegate& src) {
+		if (src.manager) src.manager(moCopy, storage, (void*)src.storage);
+		else if (src.invoker) std::memcpy(storage, src.storage, sizeof(storage)); // empty - the storage isn't set
+		invoker = src.invoker;
+		manager = src.manager;
+	}
+	void MoveFrom(Delegate& src) noexcept {
+		if (src.manager) src.manager(moMove, storage, src.storage);
+		else if (src.invoker) std::memcpy(storage, src.storage, sizeof(storage));
+		invoker = src.invoker;
+		manager = src.manager;
+		src.invoker = nullptr;
+		src.manager = nullptr;
+	}
+	void Clear() {
+		if (manager) manager(moDestroy, storage, nullptr);
+		invoker = nullptr;
+		manager = nullptr;
+	}
+
+	template <typename TObject, typename TMethod>
+	struct MethodCall {
+		TObject* Object;
+		TMethod Method;
+		TResult operator()(TArgs... args) const { return (Object->*Method)(std::forward<TArgs>(args)...); }
+	};
+
+public:
+	typedef TResult result_type;
+
+	Delegate() noexcept : invoker(nullptr), manager(nullptr) { }
+	Delegate(std::nullptr_t) noexcept : invoker(nullptr), manager(nullptr) { }
+	Delegate(const Delegate& src) { CopyFrom(src); }
+	Delegate(Delegate&& src) noexcept { MoveFrom(src); }
+	template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Delegate>::value
+		&& IsCallable<typename std::decay<F>::type>::value>::type>
+	Delegate(F&& func) : invoker(nullptr), manager(nullptr) { Assign(std::forward<F>(func)); }
+	// The member function of the object (the object must outlive the delegate)
+	template <typename TObject>
+	Delegate(TObject* object, TResult (TObject::*method)(TArgs...)) : invoker(nullptr), manager(nullptr) {
+		Assign(MethodCall<TObject, TResult (TObject::*)(TArgs...)>{ object, method });
+	}
+	template <typename TObject>
+	Delegate(const TObject* object, TResult (TObject::*method)(TArgs...) const) : invoker(nullptr), manager(nullptr) {
+		Assign(MethodCall<const TObject, TResult (TObject::*)(TArgs...) const>{ object, method });
+	}
+	~Delegate() { Clear(); }
+
+	Delegate& operator=(const Delegate& src) {
+		if (this != &src) {
+			Delegate tmp(src);
+			Clear();
+			MoveFrom(tmp);
+		}
+		return *this;
+	}
+	Delegate& operator=(Delegate&& src) noexcept {
+		if (this != &src) {
+			Clear();
+			MoveFrom(src);
+		}
+		return *this;
+	}
+	Delegate& operator=(std::nullptr_t) noexcept {
+		Clear();
+		return *this;
+	}
+	template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Delegate>::value
+		&& IsCallable<typename std::decay<F>::type>::value>::type>
+	Delegate& operator=(F&& func) {
+		Delegate tmp(std::forward<F>(func));
+		Clear();
+		MoveFrom(tmp);
+		return *this;
+	}
+
+	void swap(Delegate& other) noexcept {
+		Delegate tmp(std::move(other));
+		other = std::move(*this);
+		*this = std::move(tmp);
+	}
+
+	explicit operator bool() const noexcept { return nullptr != invoker; }
+
+	TResult operator()(TArgs... args) const {
+		if (!invoker) throw std::bad_function_call();
+		return invoker((void*)storage, std::forward<TArgs>(args)...);
+	}
+};
+
+template <typename TSignature>
+bool operator==(const Delegate<TSignature>& func, std::nullptr_t) noexcept { return !func; }
+template <typename TSignature>
+bool operator==(std::nullptr_t, const Delegate<TSignature>& func) noexcept { return !func; }
+template <typename TSignature>
+bool operator!=(const Delegate<TSignature>& func, std::nullptr_t) noexcept { return (bool)func; }
+template <typename TSignature>
+bool operator!=(std::nullptr_t, const Delegate<TSignature>& func) noexcept { return (bool)func; }
+
+#endif // #ifndef _LIS_DELEGATE_H_
@@ -3,82 +3,404 @@
 #ifndef _LIS_EVENT_DISPATCH_BASE_H_
 #define _LIS_EVENT_DISPATCH_BASE_H_
 
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <functional>
-#include <list>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Delegate.h"
+#include "EventDispQueue.h"
+#include "SyncSnapshot.h"
+
+// ************************************** EventHandlersTable ***************************************
+
+// ** Event type range trait: specialize it (EVENT_TYPE_DENSE_RANGE) for the small contiguous enums,
+// the dispatchers then keep the handlers in the fixed array indexed by the event type value
+// (no hashing); the other types are kept in unordered_map.
+template <typename TEventType>
+struct EventTypeRange
+{
+	static const bool IsDense = false;
+};
+
+// Usage (global namespace): EVENT_TYPE_DENSE_RANGE(MyEventType, evFirst, evLast)
+#define EVENT_TYPE_DENSE_RANGE(event_type, first_value, last_value) \
+	template <> struct EventTypeRange<event_type> { \
+		static const bool IsDense = true; \
+		static const long long First = (long long)(first_value); \
+		static const size_t Count = (size_t)((long long)(last_value) - (long long)(first_value) + 1); \
+	}
+
+// Event type -> TItem storage of the dispatchers. Get creates the item (nullptr - the type is out of
+// the dense range), Erase resets it.
+template <typename TEventType, typename TItem, bool IsDense = EventTypeRange<TEventType>::IsDense>
+class EventHandlersTable
+{
+	std::unordered_map<TEventType, TItem> items;
+public:
+	TItem* Find(TEventType type) {
+		auto item = items.find(type);
+		return (item != items.end()) ? &(*item).second : nullptr;
+	}
+	const TItem* Find(TEventType type) const {
+		auto item = items.find(type);
+		return (item != items.end()) ? &(*item).second : nullptr;
+	}
+	TItem* Get(TEventType type) { return &items[type]; }
+	void Erase(TEventType type) { items.erase(type); }
+	template <typename F> void ForEach(F func) { // func(type, item)
+		for (auto& item : items) func(item.first, item.second);
+	}
+	template <typename F> void ForEach(F func) const {
+		for (const auto& item : items) func(item.first, item.second);
+	}
+};
+
+template <typename TEventType, typename TItem>
+class EventHandlersTable<TEventType, TItem, true>
+{
+	typedef EventTypeRange<TEventType> Range;
+	TItem items[Range::Count];
+
+	static size_t Index(TEventType type) { return (size_t)((long long)type - Range::First); }
+public:
+	TItem* Find(TEventType type) { return (Index(type) < Range::Count) ? &items[Index(type)] : nullptr; }
+	const TItem* Find(TEventType type) const { return (Index(type) < Range::Count) ? &items[Index(type)] : nullptr; }
+	TItem* Get(TEventType type) { return Find(type); }
+	void Erase(TEventType type) {
+		if (Index(type) < Range::Count) items[Index(type)] = TItem();
+	}
+	template <typename F> void ForEach(F func) {
+		for (size_t i = 0; i < Range::Count; ++i) func((TEventType)(Range::First + (long long)i), items[i]);
+	}
+	template <typename F> void ForEach(F func) const {
+		for (size_t i = 0; i < Range::Count; ++i) func((TEventType)(Range::First + (long long)i), items[i]);
+	}
+};
+
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+// ** Dispatch profiling (EventDispatcherBase::GetEventProfile): the counters of the event type
+// (RaiseEvent / RaiseEvents calls) or of the subscription (handler calls), the time includes
+// the nested raises.
+struct EventProfileCounters
+{
+	uint64_t Calls = 0;
+	uint64_t Events = 0; // the events passed (RaiseEvents / batch handler - many per call)
+	uint64_t Stops = 0; // calls returned the negative result (stopped the event)
+	uint64_t TotalNs = 0, MaxNs = 0;
+};
+
+// Adds the call to the counters when the scope ends (result is read then)
+struct EventProfileScope
+{
+	EventProfileCounters& Counters;
+	size_t Events;
+	const int& Result;
+	std::chrono::steady_clock::time_point Start;
+
+	EventProfileScope(EventProfileCounters& counters, size_t events, const int& result)
+		: Counters(counters), Events(events), Result(result), Start(std::chrono::steady_clock::now()) { }
+	~EventProfileScope() {
+		uint64_t time_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - Start).count();
+		++Counters.Calls;
+		Counters.Events += Events;
+		if (Result < 0) ++Counters.Stops;
+		Counters.TotalNs += time_ns;
+		if (time_ns > Counters.MaxNs) Counters.MaxNs = time_ns;
+	}
+};
+#endif
+
+// Raises the batch (TBatchInfo: type, data, count) for the handler entries [entry, end) (TEntry::Call of
+// the single event Handler - for every batch item, of BatchHandler - for the runs of the items),
+// is_active(entry) - the entry isn't unsubscribed. The negative result of Handler stops the item (as
+// RaiseEvent does: the next handlers don't get it), of BatchHandler - the rest of the batch.
+// Returns the first negative result, or the result of the last call.
+template <typename TEventInfo, typename TDispatcher, typename TBatchInfo, typename TEntry, typename TIsActive>
+int EventBatchRaise(const TDispatcher* dispatcher, const TBatchInfo& batch, const TEntry* entry, const TEntry* end,
+	TIsActive is_active)
+{
+	int result = 0, stop_result = 0;
+	std::vector<bool> stopped; // allocated at the first stopped item
+	size_t stopped_count = 0;
+	for (; entry != end && stopped_count < batch.count; ++entry) {
+		if (!is_active(entry)) continue;
+		if (entry->Handler) {
+			TEventInfo evt_inf{};
+			evt_inf.type = batch.type;
+			for (size_t i = 0; i < batch.count; ++i) {
+				if (stopped_count && stopped[i]) continue;
+				evt_inf.data = batch.data[i];
+				result = entry->Call(dispatcher, evt_inf);
+				if (result >= 0) continue;
+				if (!stop_result) stop_result = result;
+				if (stopped.empty()) stopped.resize(batch.count);
+				stopped[i] = true;
+				++stopped_count;
+			}
+		} else {
+			for (size_t i = 0; i < batch.count; ) { // the runs of the items which aren't stopped
+				size_t run_end = i;
+				while (run_end < batch.count && !(stopped_count && stopped[run_end])) ++run_end;
+				if (run_end > i) {
+					TBatchInfo run = batch;
+					run.data = batch.data + i;
+					run.count = run_end - i;
+					result = entry->Call(dispatcher, run);
+					if (result < 0) return stop_result ? stop_result : result;
+				}
+				i = run_end + 1;
+			}
+		}
+	}
+	return stop_result ? stop_result : result;
+}
 
 // ** The class to be inherited.
 // TDispatcher - type of the dispatcher (assuming the derived class).
 // TEventType - type of an event (probably some enum).
 // TEventData - type of data passed when the event raised (could be a pointer).
-// Subscribe code example:
+// Subscribe code example (EventHandler is Delegate, keeps the object + member function without allocation):
 //   theDispatcher.EventSubscribe(event_type_1,
-//     std::bind(&SubscriberClass::Event1_EventHandler,
-//       &theSubscriber, std::placeholders::_1, std::placeholders::_2));
+//     TheDispatcher::EventHandler(&theSubscriber, &SubscriberClass::Event1_EventHandler));
+// The handlers of an event type are kept in the subscription order in the contiguous array,
+// the subscription id addresses the slot which knows the handler position (the generation in the id
+// makes the ids of the unsubscribed handlers invalid). Handlers may subscribe and unsubscribe
+// while the event is raised: the unsubscribed handlers aren't called anymore, the new ones are added
+// when the outermost RaiseEvent returns (aren't called for the event being raised).
+// The small contiguous enum event types should be declared by EVENT_TYPE_DENSE_RANGE (array storage).
+// RaiseEvents raises the array of the events of one type with one lookup: the batch handlers
+// (EventSubscribeBatch) get the whole array, the single event handlers are called for each event.
+// LIS_EVENT_DISPATCH_PROFILING defined: the calls and the handler times are counted per event type and
+// per subscription (GetEventProfile).
+// Queued dispatch (EventQueueStart): PostEvent returns at once, the event is raised later by the queue
+// worker (own thread or the task of ThreadTaskMgr) or by EventQueueDrain; the handlers must not be changed
+// from other threads while the worker runs (see EventDispatcherConcurrent). After EventQueueStart the events
+// are raised only through the queue: RaiseEvent / RaiseEvents may be called by the handlers (the dispatching
+// thread) only, the other threads must use PostEvent (asserted, the raise state isn't synchronized).
+// The derived class must call EventQueueStop in its destructor (the queued events are raised for
+// the complete dispatcher; asserted, the base destructor discards the events left);
+// EventQueueStart / EventQueueStop must not be called while other threads post the events.
 template <typename TDispatcher, typename TEventType, typename TEventData>
 class EventDispatcherBase
 {
 public:
 	struct EventInfo { TEventType type; TEventData data; };
 	typedef int EventFunction(const TDispatcher* dispatcher, const EventInfo& evt_info);
-	typedef std::function<EventFunction> EventHandler;
-	typedef void* EventSubscriptionId; // TODO: consider using a shared pointer instead
+	typedef Delegate<EventFunction> EventHandler;
+	struct EventBatchInfo { TEventType type; const TEventData* data; size_t count; };
+	typedef int EventBatchFunction(const TDispatcher* dispatcher, const EventBatchInfo& batch_info);
+	typedef Delegate<EventBatchFunction> EventBatchHandler;
+	typedef uint64_t EventSubscriptionId; // (generation << 32) | (slot index + 1), 0 - none
 
-	EventDispatcherBase() { }
-	EventDispatcherBase(const EventDispatcherBase& src) noexcept : eventHandlers(src.eventHandlers) { }
-	EventDispatcherBase(EventDispatcherBase&& src) noexcept : eventHandlers(std::move(src.eventHandlers)) { }
-	virtual ~EventDispatcherBase() { }
+	EventDispatcherBase() : raiseDepth(0) { }
+	EventDispatcherBase(const EventDispatcherBase& src) noexcept : eventHandlers(src.eventHandlers),
+		subscriptions(src.subscriptions), freeSlots(src.freeSlots), deferredAdds(src.deferredAdds), raiseDepth(0) { }
+	EventDispatcherBase(EventDispatcherBase&& src) noexcept : eventHandlers(std::move(src.eventHandlers)),
+		subscriptions(std::move(src.subscriptions)), freeSlots(std::move(src.freeSlots)),
+		deferredAdds(std::move(src.deferredAdds)), raiseDepth(0) { }
+	virtual ~EventDispatcherBase() {
+		assert(!eventQueue); // EventQueueStop wasn't called by the derived class destructor
+		if (eventQueue) eventQueue->Stop(true); // ERROR: the handlers would get the destroyed dispatcher
+	}
 
-	EventSubscriptionId EventSubscribe(TEventType type, EventHandler handler);
+	EventSubscriptionId EventSubscribe(TEventType type, EventHandler handler) {
+		return SubscribeEntry(type, std::move(handler), nullptr);
+	}
+	// The handler gets the events of RaiseEvents at once (RaiseEvent - as the batch of one event)
+	EventSubscriptionId EventSubscribeBatch(TEventType type, EventBatchHandler handler) {
+		return SubscribeEntry(type, nullptr, std::move(handler));
+	}
 	bool EventUnsubscribe(EventSubscriptionId subscription_id);
 	bool EventUnsubscribe(TEventType type);
 
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+	struct EventHandlerProfile { EventSubscriptionId Id; EventProfileCounters Counters; };
+	struct EventTypeProfile
+	{
+		TEventType Type;
+		EventProfileCounters Counters;
+		std::vector<EventHandlerProfile> Handlers; // in the subscription order
+	};
+	// Snapshot of the counters of the event types which were raised or have the handlers
+	void GetEventProfile(std::vector<EventTypeProfile>& profile) const;
+	void ResetEventProfile();
+#endif
+
+	bool EventQueueFlush(int wait_ms = -1) { return eventQueue ? eventQueue->Flush(wait_ms) : true; }
+	bool GetEventQueueStats(EventQueueStats& stats) const {
+		if (!eventQueue) return false;
+		stats = eventQueue->GetStats();
+		return true;
+	}
+
 protected:
 	int RaiseEvent(TEventType type, TEventData data) const;
+	// Raises the events of one type: the handlers are called in the subscription order, each for all
+	// the events (see EventBatchRaise)
+	int RaiseEvents(TEventType type, const TEventData* data, size_t count) const;
+	// The event is queued (raised at once if the queue isn't started); false - dropped
+	bool PostEvent(TEventType type, TEventData data) {
+		if (eventQueue) return eventQueue->Post(type, data);
+		RaiseEvent(type, data);
+		return true;
+	}
+	// false if called by a handler (the queue can't be replaced while it dispatches)
+	bool EventQueueStart(const EventQueueSettings& settings, LisThread::ThreadTaskMgr* task_mgr = nullptr) {
+		if (!EventQueueStop()) return false; // the events of the previous queue are raised
+		eventQueue.reset(new EventDispatchQueue<TEventType, TEventData>(settings,
+			[this](TEventType type, TEventData data) { RaiseEvent(type, data); }, task_mgr));
+		return true;
+	}
+	// The queued events are raised; false if called by a handler: the stop is only requested (the posts
+	// are rejected, the worker finishes after the handler), the owner should call it again
+	bool EventQueueStop() {
+		if (eventQueue && !eventQueue->Stop()) return false;
+		eventQueue.reset();
+		return true;
+	}
+	size_t EventQueueDrain() { return eventQueue ? eventQueue->Drain() : 0; } // for EventQueueSettings::ManualDrain
 
 private:
-	typedef std::list<EventHandler> HandlersContainer;
-	std::unordered_map<TEventType, HandlersContainer> eventHandlers;
+	static const uint32_t SlotNone = 0xFFFFFFFF; // the handler entry is unsubscribed
+	static const uint32_t IndexDeferred = 0x80000000; // the slot index refers to deferredAdds
+
+	struct HandlerEntry
+	{
+		EventHandler Handler;
+		EventBatchHandler BatchHandler; // if Handler is empty
+		uint32_t Slot;
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+		mutable EventProfileCounters Profile;
+#endif
+
+		int Call(const TDispatcher* dispatcher, const EventInfo& evt_info) const {
+			int result = 0;
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+			EventProfileScope profile_scope(Profile, 1, result);
+#endif
+			if (Handler) result = Handler(dispatcher, evt_info);
+			else result = BatchHandler(dispatcher, EventBatchInfo{ evt_info.type, &evt_info.data, 1 });
+			return result;
+		}
+		int Call(const TDispatcher* dispatcher, const EventBatchInfo& batch_info) const {
+			int result = 0;
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+			EventProfileScope profile_scope(Profile, batch_info.count, result);
+#endif
+			result = BatchHandler(dispatcher, batch_info);
+			return result;
+		}
+	};
+	struct HandlersContainer
+	{
+		std::vector<HandlerEntry> Items;
+		uint32_t Removed = 0; // unsubscribed entries (removed by Compact)
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+		mutable EventProfileCounters Profile;
+#endif
+	};
+	struct SubscriptionSlot
+	{
+		TEventType Type;
+		uint32_t Index; // position in HandlersContainer::Items (or in deferredAdds with IndexDeferred)
+		uint32_t Generation;
+		bool InUse;
+	};
+	struct RaiseScope // counts the nested RaiseEvent calls, applies the deferred changes at the end
+	{
+		const EventDispatcherBase* Owner;
+		explicit RaiseScope(const EventDispatcherBase* owner) : Owner(owner) { ++owner->raiseDepth; }
+		~RaiseScope() {
+			if (0 == --Owner->raiseDepth && Owner->hasDeferred)
+				const_cast<EventDispatcherBase*>(Owner)->ApplyDeferred();
+		}
+	};
 
-	static EventSubscriptionId GetSubscriptionId(const EventHandler& handler);
+	EventHandlersTable<TEventType, HandlersContainer> eventHandlers;
+	std::vector<SubscriptionSlot> subscriptions;
+	std::vector<uint32_t> freeSlots;
+	std::vector<std::pair<TEventType, HandlerEntry>> deferredAdds; // subscribed while raising
+	mutable unsigned raiseDepth;
+	bool hasDeferred = false;
+	std::unique_ptr<EventDispatchQueue<TEventType, TEventData>> eventQueue;
 
-	static typename HandlersContainer::iterator
-		FindHandler(HandlersContainer& list, EventSubscriptionId subscription_id);
+	EventSubscriptionId SubscribeEntry(TEventType type, EventHandler&& handler, EventBatchHandler&& batch_handler);
+	SubscriptionSlot* FindSlot(EventSubscriptionId subscription_id);
+	void FreeSlot(uint32_t slot);
+	void RemoveEntry(HandlersContainer& list, uint32_t index);
+	void Compact(HandlersContainer& list);
+	void ApplyDeferred();
 };
 
 // ******************************* EventDispatcherBase implementation ******************************
 
 template<typename TDispatcher, typename TEventType, typename TEventData>
 typename EventDispatcherBase<TDispatcher, TEventType, TEventData>::EventSubscriptionId
-EventDispatcherBase<TDispatcher, TEventType, TEventData>::EventSubscribe(
-	TEventType type, EventHandler handler)
+EventDispatcherBase<TDispatcher, TEventType, TEventData>::SubscribeEntry(
+	TEventType type, EventHandler&& handler, EventBatchHandler&& batch_handler)
 {
-	auto& list = eventHandlers[type];
-	list.push_back(handler);
-	return GetSubscriptionId(list.back());
+	HandlersContainer* list = eventHandlers.Get(type);
+	if (!list) return 0; // ERROR: the type is out of the range
+	uint32_t slot;
+	if (!freeSlots.empty()) {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	} else {
+		if (subscriptions.size() >= IndexDeferred) return 0; // ERROR: too many subscriptions
+		slot = (uint32_t)subscriptions.size();
+		subscriptions.push_back(SubscriptionSlot{ type, 0, 0, false });
+	}
+	SubscriptionSlot& sub = subscriptions[slot];
+	sub.Type = type;
+	sub.InUse = true;
+	if (raiseDepth > 0) { // the handlers array can't grow while it's iterated
+		sub.Index = IndexDeferred | (uint32_t)deferredAdds.size();
+		deferredAdds.emplace_back(type, HandlerEntry{ std::move(handler), std::move(batch_handler), slot });
+		hasDeferred = true;
+	} else {
+		sub.Index = (uint32_t)list->Items.size();
+		list->Items.push_back(HandlerEntry{ std::move(handler), std::move(batch_handler), slot });
+	}
+	return ((EventSubscriptionId)sub.Generation << 32) | (slot + 1);
 }
 
 template<typename TDispatcher, typename TEventType, typename TEventData>
 bool EventDispatcherBase<TDispatcher, TEventType, TEventData>::EventUnsubscribe(
 	EventSubscriptionId subscription_id)
 {
-	for (auto& evt : eventHandlers) {
-		auto& list = evt.second;
-		auto item = FindHandler(list, subscription_id);
-		if (item != list.end()) {
-			list.erase(item);
-			return true;
-		}
-	}
-	return false;
+	SubscriptionSlot* sub = FindSlot(subscription_id);
+	if (!sub) return false;
+	uint32_t slot = (uint32_t)(sub - subscriptions.data());
+	if (sub->Index & IndexDeferred) deferredAdds[sub->Index & ~IndexDeferred].second.Slot = SlotNone;
+	else RemoveEntry(*eventHandlers.Find(sub->Type), sub->Index);
+	FreeSlot(slot);
+	return true;
 }
 
 template<typename TDispatcher, typename TEventType, typename TEventData>
 bool EventDispatcherBase<TDispatcher, TEventType, TEventData>::EventUnsubscribe(TEventType type)
 {
-	const auto item = eventHandlers.find(type);
-	if (item != eventHandlers.end()) {
-		(*item).second.clear();
+	for (auto& deferred : deferredAdds) {
+		if (SlotNone == deferred.second.Slot || !(deferred.first == type)) continue;
+		FreeSlot(deferred.second.Slot);
+		deferred.second.Slot = SlotNone;
+	}
+	HandlersContainer* list = eventHandlers.Find(type);
+	if (list) {
+		for (auto& entry : list->Items) {
+			if (SlotNone == entry.Slot) continue;
+			FreeSlot(entry.Slot);
+			entry.Slot = SlotNone;
+		}
+		list->Removed = (uint32_t)list->Items.size();
+		if (raiseDepth > 0) hasDeferred = true;
+		else Compact(*list);
 		return true;
 	}
 	return false;
@@ -88,15 +410,23 @@ template<typename TDispatcher, typename TEventType, typename TEventData>
 int EventDispatcherBase<TDispatcher, TEventType, TEventData>::RaiseEvent(
 	TEventType type, TEventData data) const
 {
+	assert(!eventQueue || eventQueue->IsDispatchThread()); // queued dispatch: raised by the queue only
 	int result = 0;
-	const auto& item = eventHandlers.find(type);
-	if (item != eventHandlers.end()) {
-		const auto& handlers = (*item).second;
+	const HandlersContainer* list = eventHandlers.Find(type);
+	if (list) {
+		const auto& handlers = list->Items;
+		if (handlers.empty()) return result;
 		EventInfo evt_inf{};
 		evt_inf.type = type;
 		evt_inf.data = data;
-		for (const auto& handler : handlers) {
-			result = handler(static_cast<const TDispatcher*>(this), evt_inf);
+		RaiseScope raise_scope(this);
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+		EventProfileScope profile_scope(list->Profile, 1, result);
+#endif
+		const HandlerEntry* entry = handlers.data(); // not reallocated until the scope ends
+		for (const HandlerEntry* end = entry + handlers.size(); entry != end; ++entry) {
+			if (SlotNone == entry->Slot) continue;
+			result = entry->Call(static_cast<const TDispatcher*>(this), evt_inf);
 			if (result < 0) return result;
 		}
 	}
@@ -104,23 +434,336 @@ int EventDispatcherBase<TDispatcher, TEventType, TEventData>::RaiseEvent(
 }
 
 template<typename TDispatcher, typename TEventType, typename TEventData>
-typename EventDispatcherBase<TDispatcher, TEventType, TEventData>::EventSubscriptionId
-EventDispatcherBase<TDispatcher, TEventType, TEventData>::GetSubscriptionId(
-	const EventHandler& handler)
+int EventDispatcherBase<TDispatcher, TEventType, TEventData>::RaiseEvents(
+	TEventType type, const TEventData* data, size_t count) const
+{
+	assert(!eventQueue || eventQueue->IsDispatchThread()); // queued dispatch: raised by the queue only
+	const HandlersContainer* list = eventHandlers.Find(type);
+	if (!list || list->Items.empty() || 0 == count) return 0;
+	int result = 0;
+	RaiseScope raise_scope(this);
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+	EventProfileScope profile_scope(list->Profile, count, result);
+#endif
+	const HandlerEntry* entry = list->Items.data(); // not reallocated until the scope ends
+	result = EventBatchRaise<EventInfo>(static_cast<const TDispatcher*>(this), EventBatchInfo{ type, data, count },
+		entry, entry + list->Items.size(), [](const HandlerEntry* item) { return SlotNone != item->Slot; });
+	return result;
+}
+
+#ifdef LIS_EVENT_DISPATCH_PROFILING
+template<typename TDispatcher, typename TEventType, typename TEventData>
+void EventDispatcherBase<TDispatcher, TEventType, TEventData>::GetEventProfile(
+	std::vector<EventTypeProfile>& profile) const
 {
-	return (EventSubscriptionId)(&handler);
+	profile.clear();
+	eventHandlers.ForEach([this, &profile](TEventType type, const HandlersContainer& list) {
+		if (0 == list.Profile.Calls && list.Items.size() == list.Removed) return;
+		EventTypeProfile type_profile{ type, list.Profile, {} };
+		for (const auto& entry : list.Items) {
+			if (SlotNone == entry.Slot) continue;
+			EventSubscriptionId id = ((EventSubscriptionId)subscriptions[entry.Slot].Generation << 32) | (entry.Slot + 1);
+			type_profile.Handlers.push_back(EventHandlerProfile{ id, entry.Profile });
+		}
+		profile.push_back(std::move(type_profile));
+	});
 }
 
 template<typename TDispatcher, typename TEventType, typename TEventData>
-typename EventDispatcherBase<TDispatcher, TEventType, TEventData>::HandlersContainer::iterator
-EventDispatcherBase<TDispatcher, TEventType, TEventData>::FindHandler(
-	HandlersContainer& list, EventSubscriptionId subscription_id)
+void EventDispatcherBase<TDispatcher, TEventType, TEventData>::ResetEventProfile()
+{
+	eventHandlers.ForEach([](TEventType, HandlersContainer& list) {
+		list.Profile = EventProfileCounters();
+		for (auto& entry : list.Items) entry.Profile = EventProfileCounters();
+	});
+}
+#endif
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+typename EventDispatcherBase<TDispatcher, TEventType, TEventData>::SubscriptionSlot*
+EventDispatcherBase<TDispatcher, TEventType, TEventData>::FindSlot(
+	EventSubscriptionId subscription_id)
 {
-	for (auto it = list.begin(); it != list.end(); ++it) {
-		if (GetSubscriptionId(*it) == subscription_id)
-			return it;
+	uint32_t slot = (uint32_t)subscription_id - 1;
+	if (slot >= subscriptions.size()) return nullptr;
+	SubscriptionSlot& sub = subscriptions[slot];
+	return (sub.InUse && sub.Generation == (uint32_t)(subscription_id >> 32)) ? &sub : nullptr;
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+void EventDispatcherBase<TDispatcher, TEventType, TEventData>::FreeSlot(uint32_t slot)
+{
+	SubscriptionSlot& sub = subscriptions[slot];
+	sub.InUse = false;
+	++sub.Generation;
+	freeSlots.push_back(slot);
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+void EventDispatcherBase<TDispatcher, TEventType, TEventData>::RemoveEntry(
+	HandlersContainer& list, uint32_t index)
+{
+	list.Items[index].Slot = SlotNone;
+	++list.Removed;
+	if (raiseDepth > 0) { // the handler may be running
+		hasDeferred = true;
+		return;
 	}
-	return list.end();
+	list.Items[index].Handler = nullptr;
+	list.Items[index].BatchHandler = nullptr;
+	if (list.Removed * 2 > list.Items.size()) Compact(list); // amortized O(1)
+}
+
+// Removes the unsubscribed entries keeping the order of the rest
+template<typename TDispatcher, typename TEventType, typename TEventData>
+void EventDispatcherBase<TDispatcher, TEventType, TEventData>::Compact(HandlersContainer& list)
+{
+	uint32_t count = 0;
+	for (auto& entry : list.Items) {
+		if (SlotNone == entry.Slot) continue;
+		subscriptions[entry.Slot].Index = count;
+		if (&list.Items[count] != &entry) list.Items[count] = std::move(entry);
+		++count;
+	}
+	list.Items.erase(list.Items.begin() + count, list.Items.end());
+	list.Removed = 0;
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+void EventDispatcherBase<TDispatcher, TEventType, TEventData>::ApplyDeferred()
+{
+	hasDeferred = false;
+	eventHandlers.ForEach([this](TEventType, HandlersContainer& list) {
+		if (list.Removed > 0) Compact(list);
+	});
+	for (auto& deferred : deferredAdds) {
+		if (SlotNone == deferred.second.Slot) continue;
+		HandlersContainer* list = eventHandlers.Get(deferred.first); // created by EventSubscribe
+		subscriptions[deferred.second.Slot].Index = (uint32_t)list->Items.size();
+		list->Items.push_back(std::move(deferred.second));
+	}
+	deferredAdds.clear();
+}
+
+// *********************************** EventDispatcherConcurrent ***********************************
+
+// ** Thread-safe variant of EventDispatcherBase (the same interface).
+// RaiseEvent takes the current immutable snapshot of the handlers without locks, EventSubscribe and
+// EventUnsubscribe (serialized) publish the new snapshot; the replaced snapshots are deleted when
+// no RaiseEvent uses them (see LisThread::SnapshotPtr). Handlers may subscribe and unsubscribe
+// (themselves too) while the event is raised: the raise in progress calls the handlers of the
+// snapshot taken at its start. Queued dispatch - as in EventDispatcherBase, the handlers may be
+// changed from any thread.
+// The unsubscribed handler (with its captured state) may outlive EventUnsubscribe: it's destroyed
+// with the last snapshot referring to it, by a later subscription change or RaiseEvent (after the raises
+// in progress finish), or by EventReclaim.
+template <typename TDispatcher, typename TEventType, typename TEventData>
+class EventDispatcherConcurrent
+{
+public:
+	struct EventInfo { TEventType type; TEventData data; };
+	typedef int EventFunction(const TDispatcher* dispatcher, const EventInfo& evt_info);
+	typedef Delegate<EventFunction> EventHandler;
+	struct EventBatchInfo { TEventType type; const TEventData* data; size_t count; };
+	typedef int EventBatchFunction(const TDispatcher* dispatcher, const EventBatchInfo& batch_info);
+	typedef Delegate<EventBatchFunction> EventBatchHandler;
+	typedef uint64_t EventSubscriptionId; // 0 - none
+
+	EventDispatcherConcurrent() : lastId(0) { }
+	EventDispatcherConcurrent(const EventDispatcherConcurrent& src);
+	virtual ~EventDispatcherConcurrent() {
+		assert(!eventQueue); // EventQueueStop wasn't called by the derived class destructor
+		if (eventQueue) eventQueue->Stop(true); // ERROR: the handlers would get the destroyed dispatcher
+	}
+
+	EventSubscriptionId EventSubscribe(TEventType type, EventHandler handler) {
+		return SubscribeEntry(type, std::move(handler), nullptr);
+	}
+	// The handler gets the events of RaiseEvents at once (RaiseEvent - as the batch of one event)
+	EventSubscriptionId EventSubscribeBatch(TEventType type, EventBatchHandler handler) {
+		return SubscribeEntry(type, nullptr, std::move(handler));
+	}
+	bool EventUnsubscribe(EventSubscriptionId subscription_id);
+	bool EventUnsubscribe(TEventType type);
+	// Deletes the replaced handlers snapshots (the unsubscribed handlers) no raise uses anymore;
+	// wait_raises = true waits for the raises in progress (must not be called from a handler)
+	bool EventReclaim(bool wait_raises = false) { return eventHandlers.Reclaim(wait_raises); }
+
+	bool EventQueueFlush(int wait_ms = -1) { return eventQueue ? eventQueue->Flush(wait_ms) : true; }
+	bool GetEventQueueStats(EventQueueStats& stats) const {
+		if (!eventQueue) return false;
+		stats = eventQueue->GetStats();
+		return true;
+	}
+
+protected:
+	int RaiseEvent(TEventType type, TEventData data) const {
+		int result = RaiseSnapshot(type, data);
+		eventHandlers.TryReclaim(); // the snapshots replaced while the events keep coming
+		return result;
+	}
+	// Raises the events of one type: the handlers are called in the subscription order, each for all
+	// the events (see EventBatchRaise)
+	int RaiseEvents(TEventType type, const TEventData* data, size_t count) const {
+		int result = RaiseSnapshot(type, data, count);
+		eventHandlers.TryReclaim();
+		return result;
+	}
+	// The event is queued (raised at once if the queue isn't started); false - dropped
+	bool PostEvent(TEventType type, TEventData data) {
+		if (eventQueue) return eventQueue->Post(type, data);
+		RaiseEvent(type, data);
+		return true;
+	}
+	// false if called by a handler (the queue can't be replaced while it dispatches)
+	bool EventQueueStart(const EventQueueSettings& settings, LisThread::ThreadTaskMgr* task_mgr = nullptr) {
+		if (!EventQueueStop()) return false; // the events of the previous queue are raised
+		eventQueue.reset(new EventDispatchQueue<TEventType, TEventData>(settings,
+			[this](TEventType type, TEventData data) { RaiseEvent(type, data); }, task_mgr));
+		return true;
+	}
+	// The queued events are raised; false if called by a handler: the stop is only requested (the posts
+	// are rejected, the worker finishes after the handler), the owner should call it again
+	bool EventQueueStop() {
+		if (eventQueue && !eventQueue->Stop()) return false;
+		eventQueue.reset();
+		return true;
+	}
+	size_t EventQueueDrain() { return eventQueue ? eventQueue->Drain() : 0; } // for EventQueueSettings::ManualDrain
+
+private:
+	struct HandlerEntry
+	{
+		EventHandler Handler;
+		EventBatchHandler BatchHandler; // if Handler is empty
+		EventSubscriptionId Id;
+
+		int Call(const TDispatcher* dispatcher, const EventInfo& evt_info) const {
+			if (Handler) return Handler(dispatcher, evt_info);
+			return BatchHandler(dispatcher, EventBatchInfo{ evt_info.type, &evt_info.data, 1 });
+		}
+		int Call(const TDispatcher* dispatcher, const EventBatchInfo& batch_info) const {
+			return BatchHandler(dispatcher, batch_info);
+		}
+	};
+	typedef std::vector<HandlerEntry> HandlersContainer;
+	// The snapshot copy shares the handler arrays of the event types which aren't changed
+	typedef EventHandlersTable<TEventType, std::shared_ptr<const HandlersContainer>> HandlersMap;
+
+	mutable LisThread::SnapshotPtr<HandlersMap> eventHandlers; // reclaimed by the raise
+	mutable std::mutex subscribeSync;
+	std::unordered_map<EventSubscriptionId, TEventType> subscriptions;
+	EventSubscriptionId lastId;
+	std::unique_ptr<EventDispatchQueue<TEventType, TEventData>> eventQueue;
+
+	EventSubscriptionId SubscribeEntry(TEventType type, EventHandler&& handler, EventBatchHandler&& batch_handler);
+	int RaiseSnapshot(TEventType type, TEventData data) const;
+	int RaiseSnapshot(TEventType type, const TEventData* data, size_t count) const;
+};
+
+// *************************** EventDispatcherConcurrent implementation ****************************
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::EventDispatcherConcurrent(
+	const EventDispatcherConcurrent& src) : lastId(0)
+{
+	std::lock_guard<std::mutex> sync_lock(src.subscribeSync);
+	typename LisThread::SnapshotPtr<HandlersMap>::ReadGuard src_handlers(src.eventHandlers);
+	eventHandlers.Update([&src_handlers](HandlersMap& handlers) {
+		handlers = *src_handlers;
+		return true;
+	}, false);
+	subscriptions = src.subscriptions;
+	lastId = src.lastId;
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+typename EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::EventSubscriptionId
+EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::SubscribeEntry(
+	TEventType type, EventHandler&& handler, EventBatchHandler&& batch_handler)
+{
+	std::lock_guard<std::mutex> sync_lock(subscribeSync);
+	EventSubscriptionId id = lastId + 1;
+	if (!eventHandlers.Update([&](HandlersMap& handlers) {
+			auto list = handlers.Get(type);
+			if (!list) return false; // ERROR: the type is out of the range
+			auto new_list = *list ? std::make_shared<HandlersContainer>(**list) : std::make_shared<HandlersContainer>();
+			new_list->push_back(HandlerEntry{ std::move(handler), std::move(batch_handler), id });
+			*list = std::move(new_list);
+			return true;
+		}, false)) // a handler may subscribe while its snapshot is read
+		return 0;
+	lastId = id;
+	subscriptions[id] = type;
+	return id;
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+bool EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::EventUnsubscribe(
+	EventSubscriptionId subscription_id)
+{
+	std::lock_guard<std::mutex> sync_lock(subscribeSync);
+	const auto sub = subscriptions.find(subscription_id);
+	if (sub == subscriptions.end()) return false;
+	TEventType type = (*sub).second;
+	subscriptions.erase(sub);
+	eventHandlers.Update([type, subscription_id](HandlersMap& handlers) {
+		auto list = handlers.Find(type);
+		if (!list || !*list) return false;
+		auto new_list = std::make_shared<HandlersContainer>();
+		new_list->reserve((*list)->size());
+		for (const auto& entry : **list) {
+			if (entry.Id != subscription_id) new_list->push_back(entry);
+		}
+		if (new_list->empty()) handlers.Erase(type);
+		else *list = std::move(new_list);
+		return true;
+	}, false);
+	return true;
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+bool EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::EventUnsubscribe(TEventType type)
+{
+	std::lock_guard<std::mutex> sync_lock(subscribeSync);
+	return eventHandlers.Update([this, type](HandlersMap& handlers) {
+		auto list = handlers.Find(type);
+		if (!list || !*list) return false;
+		for (const auto& entry : **list) subscriptions.erase(entry.Id);
+		handlers.Erase(type);
+		return true;
+	}, false);
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+int EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::RaiseSnapshot(
+	TEventType type, TEventData data) const
+{
+	int result = 0;
+	typename LisThread::SnapshotPtr<HandlersMap>::ReadGuard handlers_map(eventHandlers);
+	auto list = handlers_map->Find(type);
+	if (list && *list) {
+		EventInfo evt_inf{};
+		evt_inf.type = type;
+		evt_inf.data = data;
+		for (const auto& entry : **list) {
+			result = entry.Call(static_cast<const TDispatcher*>(this), evt_inf);
+			if (result < 0) return result;
+		}
+	}
+	return result;
+}
+
+template<typename TDispatcher, typename TEventType, typename TEventData>
+int EventDispatcherConcurrent<TDispatcher, TEventType, TEventData>::RaiseSnapshot(
+	TEventType type, const TEventData* data, size_t count) const
+{
+	typename LisThread::SnapshotPtr<HandlersMap>::ReadGuard handlers_map(eventHandlers);
+	auto list = handlers_map->Find(type);
+	if (!list || !*list || 0 == count) return 0;
+	const HandlerEntry* entry = (*list)->data();
+	return EventBatchRaise<EventInfo>(static_cast<const TDispatcher*>(this), EventBatchInfo{ type, data, count },
+		entry, entry + (*list)->size(), [](const HandlerEntry*) { return true; });
 }
 
 #endif // #ifndef _LIS_EVENT_DISPATCH_BASE_H_
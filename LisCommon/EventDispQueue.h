@@ -0,0 +1,310 @@
+// ****** Events dispatcher queue (queued dispatch). (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_EVENT_DISPATCH_QUEUE_H_
+#define _LIS_EVENT_DISPATCH_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "ThreadTaskMgr.h"
+
+enum EventQueueOverflow {
+	eqoBlock, // PostEvent waits for the free place (a handler posting to the full queue from the dispatching
+		// thread would wait for itself: the event is discarded, see EventQueueStats::DroppedReentrant)
+	eqoDropNewest, // the posted event is discarded
+	eqoDropOldest // the oldest queued event is discarded
+};
+
+struct EventQueueSettings
+{
+	size_t Capacity = 0x400; // events
+	EventQueueOverflow Overflow = eqoBlock;
+	bool Coalesce = false; // the queued (not dispatched yet) event of the same type takes the newer data
+	bool ManualDrain = false; // no worker, the events are dispatched by Drain / Flush
+};
+
+struct EventQueueStats
+{
+	uint64_t Posted, Dispatched, Coalesced, DroppedNewest, DroppedOldest;
+	uint64_t Blocked; // posts which waited for the free place
+	uint64_t DroppedReentrant; // eqoBlock: posts of the dispatching thread (handlers) to the full queue
+	size_t MaxDepth; // the most events queued at once
+};
+
+// ** Bounded FIFO of the events dispatched by the worker thread (own one or the task of ThreadTaskMgr),
+// or by the caller of Drain (ManualDrain). Used by the dispatchers, see EventDispatcherBase::PostEvent.
+template <typename TEventType, typename TEventData>
+class EventDispatchQueue
+{
+public:
+	typedef std::function<void(TEventType type, TEventData data)> DispatchFunc;
+
+	EventDispatchQueue(const EventQueueSettings& queue_settings, DispatchFunc dispatch_func,
+		LisThread::ThreadTaskMgr* task_mgr = nullptr);
+	~EventDispatchQueue() { Stop(); }
+	EventDispatchQueue(const EventDispatchQueue&) = delete;
+	EventDispatchQueue& operator=(const EventDispatchQueue&) = delete;
+
+	bool Post(TEventType type, TEventData data); // false - dropped (or the queue is stopped)
+	size_t Drain(); // dispatches the queued events on the calling thread, returns their count
+	// Waits till the events posted before the call are dispatched (wait_ms < 0 - no time limit), ManualDrain -
+	// drains on the calling thread till then; false on timeout or if called by a handler (dispatching thread)
+	bool Flush(int wait_ms = -1);
+	EventQueueStats GetStats() const;
+	bool IsDispatchThread() const; // the calling thread dispatches the events now (a handler is running)
+	// Dispatches the queued events (discard - drops them, the batch being dispatched too), the events posted
+	// after (e.g. by the handlers) are rejected; false if called by a handler (dispatching thread): the stop
+	// is only requested, the worker finishes after the handler returns, Stop should be called again by the owner
+	bool Stop(bool discard = false);
+
+private:
+	static const size_t DrainBatchMax = 0x40; // events taken from the queue at once
+
+	struct Item { TEventType Type; TEventData Data; };
+
+	EventQueueSettings settings;
+	DispatchFunc dispatchFunc;
+	std::vector<Item> items; // ring, the event sequence number % capacity
+	uint64_t pushed, popped, doneSeq; // sequence numbers: next posted, next taken, all before are dispatched
+	std::unordered_map<TEventType, uint64_t> queuedTypes; // coalescing: the queued event of the type
+	mutable std::mutex queueSync;
+	std::condition_variable itemsCond, spaceCond, doneCond;
+	std::mutex drainSync; // one drain at a time keeps the events order
+	std::vector<Item> drainBatch;
+	EventQueueStats stats;
+	bool stopFlag;
+	std::atomic<bool> discardFlag; // Stop(true): the drain in progress skips the rest of its batch
+	bool taskStopped; // the worker task is stopped by ThreadTaskMgr (the manager may be gone)
+	std::thread* workerThread;
+	std::thread::id drainId; // the thread which dispatches the events
+	std::function<void()> taskStop; // stops the worker task of ThreadTaskMgr
+
+	void PopOldest(); // queueSync is locked
+	void WorkerProc(const LisThread::TaskProcCtrl* proc_ctrl);
+};
+
+// ******************************* EventDispatchQueue implementation *******************************
+
+template<typename TEventType, typename TEventData>
+EventDispatchQueue<TEventType, TEventData>::EventDispatchQueue(const EventQueueSettings& queue_settings,
+	DispatchFunc dispatch_func, LisThread::ThreadTaskMgr* task_mgr)
+	: settings(queue_settings), dispatchFunc(dispatch_func), pushed(0), popped(0), doneSeq(0), stats(),
+	stopFlag(false), discardFlag(false), taskStopped(false), workerThread(nullptr)
+{
+	settings.Capacity = std::max<size_t>(1, settings.Capacity);
+	items.resize(settings.Capacity);
+	if (settings.ManualDrain) return;
+	if (task_mgr) {
+		LisThread::TaskId task_id = "EventDispatchQueue_" + std::to_string((uintptr_t)this);
+		if (task_mgr->StartTask(task_id, [this](LisThread::TaskProcCtrl* proc_ctrl, LisThread::TaskWorkData work_data) {
+				proc_ctrl->StopFunc = [this]() { // the manager stops the task: the queue is stopped, Stop drains it
+					{
+						std::lock_guard<std::mutex> sync_lock(queueSync);
+						stopFlag = true;
+						taskStopped = true;
+					}
+					itemsCond.notify_all();
+					spaceCond.notify_all();
+				};
+				WorkerProc(proc_ctrl);
+				return 0;
+			}, nullptr)) {
+			taskStop = [task_mgr, task_id]() { task_mgr->StopTask(task_id); };
+			return;
+		} // ERROR: the task isn't started, use own thread
+	}
+	workerThread = new std::thread(&EventDispatchQueue::WorkerProc, this, nullptr);
+}
+
+template<typename TEventType, typename TEventData>
+bool EventDispatchQueue<TEventType, TEventData>::Stop(bool discard)
+{
+	bool is_task_stopped, is_handler;
+	{
+		std::lock_guard<std::mutex> sync_lock(queueSync);
+		stopFlag = true;
+		is_task_stopped = taskStopped;
+		is_handler = std::this_thread::get_id() == drainId;
+		if (discard) {
+			discardFlag = true;
+			while (pushed != popped) PopOldest();
+		}
+	}
+	itemsCond.notify_all();
+	spaceCond.notify_all();
+	if (is_handler) return false; // ERROR: the worker would wait for itself
+	if (workerThread) { // the worker drains the queue before it finishes
+		workerThread->join();
+		delete workerThread;
+		workerThread = nullptr;
+	}
+	if (taskStop) {
+		if (!is_task_stopped) taskStop();
+		taskStop = nullptr;
+	}
+	Drain();
+	return true;
+}
+
+template<typename TEventType, typename TEventData>
+bool EventDispatchQueue<TEventType, TEventData>::Post(TEventType type, TEventData data)
+{
+	std::unique_lock<std::mutex> sync_lock(queueSync);
+	if (stopFlag) return false;
+	if (settings.Coalesce) {
+		auto queued = queuedTypes.find(type);
+		if (queued != queuedTypes.end()) {
+			items[(*queued).second % settings.Capacity].Data = data;
+			++stats.Coalesced;
+			return true;
+		}
+	}
+	if (pushed - popped >= settings.Capacity) {
+		switch (settings.Overflow) {
+		case eqoDropNewest:
+			++stats.DroppedNewest;
+			return false;
+		case eqoDropOldest:
+			PopOldest();
+			++stats.DroppedOldest;
+			break;
+		default:
+			if (std::this_thread::get_id() == drainId) { // the handler would wait for its own drain
+				++stats.DroppedReentrant;
+				return false;
+			}
+			++stats.Blocked;
+			spaceCond.wait(sync_lock, [this] { return stopFlag || pushed - popped < settings.Capacity; });
+			if (stopFlag) return false;
+		}
+	}
+	Item& item = items[pushed % settings.Capacity];
+	item.Type = type;
+	item.Data = data;
+	if (settings.Coalesce) queuedTypes[type] = pushed;
+	++pushed;
+	++stats.Posted;
+	stats.MaxDepth = std::max(stats.MaxDepth, (size_t)(pushed - popped));
+	sync_lock.unlock();
+	itemsCond.notify_one();
+	return true;
+}
+
+template<typename TEventType, typename TEventData>
+void EventDispatchQueue<TEventType, TEventData>::PopOldest()
+{
+	if (settings.Coalesce) {
+		const Item& item = items[popped % settings.Capacity];
+		auto queued = queuedTypes.find(item.Type);
+		if (queued != queuedTypes.end() && (*queued).second == popped) queuedTypes.erase(queued);
+	}
+	++popped;
+}
+
+template<typename TEventType, typename TEventData>
+size_t EventDispatchQueue<TEventType, TEventData>::Drain()
+{
+	{
+		std::lock_guard<std::mutex> sync_lock(queueSync);
+		if (std::this_thread::get_id() == drainId) return 0; // called by a handler
+	}
+	std::lock_guard<std::mutex> drain_lock(drainSync);
+	{
+		std::lock_guard<std::mutex> sync_lock(queueSync);
+		drainId = std::this_thread::get_id();
+	}
+	size_t count = 0;
+	for (;;) {
+		uint64_t batch_end;
+		{
+			std::lock_guard<std::mutex> sync_lock(queueSync);
+			size_t batch_size = (size_t)std::min<uint64_t>(pushed - popped, (uint64_t)DrainBatchMax);
+			if (0 == batch_size) {
+				drainId = std::thread::id();
+				break;
+			}
+			drainBatch.clear();
+			for (size_t i = 0; i < batch_size; ++i) {
+				drainBatch.push_back(items[popped % settings.Capacity]);
+				PopOldest();
+			}
+			batch_end = popped;
+		}
+		spaceCond.notify_all();
+		for (const Item& item : drainBatch) {
+			if (discardFlag.load(std::memory_order_relaxed)) break;
+			dispatchFunc(item.Type, item.Data);
+		}
+		{
+			std::lock_guard<std::mutex> sync_lock(queueSync);
+			doneSeq = batch_end;
+			stats.Dispatched += drainBatch.size();
+		}
+		doneCond.notify_all();
+		count += drainBatch.size();
+	}
+	return count;
+}
+
+template<typename TEventType, typename TEventData>
+bool EventDispatchQueue<TEventType, TEventData>::Flush(int wait_ms)
+{
+	std::unique_lock<std::mutex> sync_lock(queueSync);
+	if (std::this_thread::get_id() == drainId) return false; // ERROR: called by a handler, would wait for itself
+	uint64_t flush_seq = pushed;
+	auto is_done = [this, flush_seq] { return doneSeq >= flush_seq; };
+	if (settings.ManualDrain) { // no worker: drain on this thread till the events before the call are dispatched
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+		while (!is_done()) {
+			if (wait_ms >= 0 && std::chrono::steady_clock::now() >= deadline) return false;
+			sync_lock.unlock();
+			if (0 == Drain()) std::this_thread::yield(); // the other thread's drain is finishing
+			sync_lock.lock();
+		}
+		return true;
+	}
+	if (wait_ms < 0) doneCond.wait(sync_lock, is_done);
+	else return doneCond.wait_for(sync_lock, std::chrono::milliseconds(wait_ms), is_done);
+	return true;
+}
+
+template<typename TEventType, typename TEventData>
+EventQueueStats EventDispatchQueue<TEventType, TEventData>::GetStats() const
+{
+	std::lock_guard<std::mutex> sync_lock(queueSync);
+	return stats;
+}
+
+template<typename TEventType, typename TEventData>
+bool EventDispatchQueue<TEventType, TEventData>::IsDispatchThread() const
+{
+	std::lock_guard<std::mutex> sync_lock(queueSync);
+	return std::this_thread::get_id() == drainId;
+}
+
+template<typename TEventType, typename TEventData>
+void EventDispatchQueue<TEventType, TEventData>::WorkerProc(const LisThread::TaskProcCtrl* proc_ctrl)
+{
+	std::unique_lock<std::mutex> sync_lock(queueSync);
+	for (;;) {
+		itemsCond.wait(sync_lock, [this, proc_ctrl] {
+			return stopFlag || pushed != popped || (proc_ctrl && proc_ctrl->StopFlag);
+		});
+		if (taskStopped || (proc_ctrl && proc_ctrl->StopFlag)) break; // the manager waits, the rest is left to Stop
+		bool is_stop = stopFlag;
+		sync_lock.unlock();
+		Drain();
+		sync_lock.lock();
+		if (is_stop && pushed == popped) break;
+	}
+}
+
+#endif // #ifndef _LIS_EVENT_DISPATCH_QUEUE_H_
@@ -13,22 +13,39 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #endif
 
 #include <sys/stat.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "StrUtils.h"
 
 #define FILE_DATA_BUFFER_SIZE 0x1000 // 4k
+#define FILE_DIR_LIST_AHEAD 0x400 // directories read ahead by DirEnumParallel (ordered)
 
 using namespace LisFileSys;
 const DirEnumOptions LisFileSys::DirEnumDefaultOptions = deoFiles;
 
 static bool FileSystem_IsSysDirFileName(const FILE_PATH_CHAR* file_name);
 
+struct FileSystem_DirItem {
+	std::basic_string<FILE_PATH_CHAR> Name; bool IsDir;
+	FileEntry::FileInfo Info;
+};
+// Reads the directory (dir_path ends with the separator) for DirEnumParallel: the subdirectories (but
+// the sys ones) and the files which DirEnum reports with the options
+static void FileSystem_DirList(const FILE_PATH_CHAR* dir_path, const FILE_PATH_CHAR* file_mask,
+	DirEnumOptions options, std::vector<FileSystem_DirItem>& items);
+
 #ifdef _WINDOWS
 // ************************************* Windows related code **************************************
 
@@ -83,6 +100,26 @@ int LisFileSys::DirEnum(DirEnumItemProc item_proc, const FILE_PATH_CHAR* dir_pat
 	return result;
 }
 
+static void FileSystem_DirList(const FILE_PATH_CHAR* dir_path, const FILE_PATH_CHAR* file_mask,
+	DirEnumOptions options, std::vector<FileSystem_DirItem>& items)
+{
+	WIN32_FIND_DATA wfd_file;
+	HANDLE ff_handle = FindFirstFile(
+		(std::basic_string<FILE_PATH_CHAR>(dir_path) + (file_mask ? file_mask : FILE_PATH_TEXT("*"))).c_str(), &wfd_file);
+	if (INVALID_HANDLE_VALUE == ff_handle) return;
+	do {
+		bool is_dir = 0 != (FILE_ATTRIBUTE_DIRECTORY & wfd_file.dwFileAttributes);
+		if (is_dir ? FileSystem_IsSysDirFileName(wfd_file.cFileName) : !(deoFiles & options)) continue;
+		FileSystem_DirItem item;
+		item.Name = wfd_file.cFileName;
+		item.IsDir = is_dir;
+		item.Info.Changed = FileSystem_FileTimeToTime(wfd_file.ftLastWriteTime);
+		item.Info.Size = ((uint64_t)wfd_file.nFileSizeHigh << 32) + wfd_file.nFileSizeLow;
+		items.push_back(std::move(item));
+	} while (FindNextFile(ff_handle, &wfd_file));
+	FindClose(ff_handle);
+}
+
 bool LisFileSys::DirDelete(const FILE_PATH_CHAR* dir_path)
 {
 	return RemoveDirectory(dir_path);
@@ -106,6 +143,18 @@ bool LisFileSys::FileDelete(const FILE_PATH_CHAR* file_path)
 	return DeleteFile(file_path);
 }
 
+bool LisFileSys::FileTruncate(const FILE_PATH_CHAR* file_path, unsigned long long size)
+{
+	HANDLE handle = CreateFile(file_path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == handle) return false;
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)size;
+	bool result = SetFilePointerEx(handle, pos, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+	CloseHandle(handle);
+	return result;
+}
+
 bool LisFileSys::FileExistCheck(const FILE_PATH_CHAR* path)
 {
 	return GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES;
@@ -135,13 +184,35 @@ static bool FileSystem_IsFileNameMatches(const char* file_name, const char* file
 	return false;
 }
 
+// The entry type (DT_REG, DT_DIR, not changed for other types) and info by the name relative to the directory
+static bool FileSystem_DirEntryStat(int dir_fd, const char* name, unsigned char& type, FileEntry::FileInfo& info)
+{
+	mode_t mode;
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+	struct statx ent_stat; // only the requested fields are retrieved
+	if (0 != statx(dir_fd, name, AT_NO_AUTOMOUNT, STATX_TYPE | STATX_MTIME | STATX_SIZE, &ent_stat)) return false;
+	mode = ent_stat.stx_mode;
+	info.Changed = (std::time_t)ent_stat.stx_mtime.tv_sec;
+	info.Size = ent_stat.stx_size;
+#else
+	struct stat ent_stat;
+	if (0 != fstatat(dir_fd, name, &ent_stat, 0)) return false;
+	mode = ent_stat.st_mode;
+	info.Changed = ent_stat.st_mtime;
+	info.Size = (uint64_t)ent_stat.st_size;
+#endif
+	if (S_ISREG(mode)) type = DT_REG;
+	else if (S_ISDIR(mode)) type = DT_DIR;
+	return true;
+}
+
 static int FileSystem_DirEnumItemProc(DirEnumItemProc item_proc,
-	bool is_dir, const FILE_PATH_CHAR* file_path)
+	bool is_dir, const FILE_PATH_CHAR* file_path, const FileEntry::FileInfo& file_info)
 {
 	FileEntry file_item;
 	file_item.Path = file_path;
 	file_item.IsDir = is_dir;
-	file_item.Info = {}; // TODO: get the file info (use stat)
+	file_item.Info = file_info;
 	return item_proc(file_item) ? 0 : -1; // ERROR: interrupted
 }
 
@@ -151,36 +222,37 @@ int LisFileSys::DirEnum(DirEnumItemProc item_proc, const FILE_PATH_CHAR* dir_pat
 	int result = 0;
 	DIR* dir0 = opendir(dir_path);
 	if (dir0 != nullptr) {
+		int dir_fd = dirfd(dir0);
 		struct dirent* dir_ent;
 		while (result >= 0 && NULL != (dir_ent = readdir(dir0))) {
-			if (DT_UNKNOWN == dir_ent->d_type) {
-				struct stat ent_stat;
-				int stat_res = stat(
-					LisStr::CStrConcat(dir_path, FILE_PATH_SEPARATOR_STR, dir_ent->d_name, 0),
-					&ent_stat);
-				if (0 == stat_res) {
-					if (S_ISREG(ent_stat.st_mode)) dir_ent->d_type = DT_REG;
-					else if (S_ISDIR(ent_stat.st_mode)) dir_ent->d_type = DT_DIR;
-				}
-			}
+			FileEntry::FileInfo file_info = {};
+			bool has_info = false;
+			if (DT_UNKNOWN == dir_ent->d_type)
+				has_info = FileSystem_DirEntryStat(dir_fd, dir_ent->d_name, dir_ent->d_type, file_info);
 
 			bool is_dir = DT_DIR == dir_ent->d_type;
 			if (!is_dir && (DT_REG != dir_ent->d_type)) continue; // Skip this entry: it's not a regular file and not a dir
 			if (is_dir && FileSystem_IsSysDirFileName(dir_ent->d_name)) continue;
+			bool is_reported = (is_dir && (deoRecursive & options)) ? 0 != ((deoDirFirst | deoDirLast) & options)
+				: (deoFiles & options) && FileSystem_IsFileNameMatches(dir_ent->d_name, file_mask);
+			if (is_reported && !has_info && (deoFileInfo & options)) {
+				unsigned char ent_type = dir_ent->d_type;
+				FileSystem_DirEntryStat(dir_fd, dir_ent->d_name, ent_type, file_info);
+			}
 
 			char file_path[PATH_MAX];
 			LisStr::StrConcat(file_path, dir_path, dir_ent->d_name, 0);
 			if (is_dir && (deoRecursive & options)) {
 				if (deoDirFirst & options)
-					result = FileSystem_DirEnumItemProc(item_proc, is_dir, file_path);
+					result = FileSystem_DirEnumItemProc(item_proc, is_dir, file_path, file_info);
 				if (result >= 0 && (deoRecursive & options)) // Recursive search in subdirectory
 					result = DirEnum(item_proc,
 						LisStr::CStrConcat(file_path, FILE_PATH_SEPARATOR_STR, 0),
 						file_mask, options);
 				if (result >= 0 && (deoDirLast & options))
-					result = FileSystem_DirEnumItemProc(item_proc, is_dir, file_path);
-			} else if ((deoFiles & options) && FileSystem_IsFileNameMatches(dir_ent->d_name, file_mask)) {
-				result = FileSystem_DirEnumItemProc(item_proc, is_dir, file_path);
+					result = FileSystem_DirEnumItemProc(item_proc, is_dir, file_path, file_info);
+			} else if (is_reported) {
+				result = FileSystem_DirEnumItemProc(item_proc, is_dir, file_path, file_info);
 			}
 		}
 		closedir(dir0);
@@ -188,6 +260,31 @@ int LisFileSys::DirEnum(DirEnumItemProc item_proc, const FILE_PATH_CHAR* dir_pat
 	return result;
 }
 
+static void FileSystem_DirList(const FILE_PATH_CHAR* dir_path, const FILE_PATH_CHAR* file_mask,
+	DirEnumOptions options, std::vector<FileSystem_DirItem>& items)
+{
+	DIR* dir0 = opendir(dir_path);
+	if (!dir0) return;
+	int dir_fd = dirfd(dir0);
+	struct dirent* dir_ent;
+	while (NULL != (dir_ent = readdir(dir0))) {
+		FileEntry::FileInfo file_info = {};
+		bool has_info = false;
+		if (DT_UNKNOWN == dir_ent->d_type)
+			has_info = FileSystem_DirEntryStat(dir_fd, dir_ent->d_name, dir_ent->d_type, file_info);
+		bool is_dir = DT_DIR == dir_ent->d_type;
+		if (is_dir ? FileSystem_IsSysDirFileName(dir_ent->d_name)
+			: DT_REG != dir_ent->d_type || !(deoFiles & options) || !FileSystem_IsFileNameMatches(dir_ent->d_name, file_mask))
+			continue;
+		if (!has_info && (deoFileInfo & options)) {
+			unsigned char ent_type = dir_ent->d_type;
+			FileSystem_DirEntryStat(dir_fd, dir_ent->d_name, ent_type, file_info);
+		}
+		items.push_back(FileSystem_DirItem{ dir_ent->d_name, is_dir, file_info });
+	}
+	closedir(dir0);
+}
+
 static bool FileSystem_DirExistenceCheck(const char* dir_path, bool auto_create)
 {
 	struct stat info;
@@ -213,6 +310,11 @@ bool LisFileSys::FileDelete(const FILE_PATH_CHAR* file_path)
 	return 0 == remove(file_path);
 }
 
+bool LisFileSys::FileTruncate(const FILE_PATH_CHAR* file_path, unsigned long long size)
+{
+	return 0 == truncate(file_path, (off_t)size);
+}
+
 bool LisFileSys::FileExistCheck(const FILE_PATH_CHAR* path)
 {
 	struct stat info;
@@ -230,6 +332,234 @@ static bool FileSystem_IsSysDirFileName(const FILE_PATH_CHAR* file_name)
 		&& (0 == file_name[1] || ((FILE_PATH_CHAR)'.' == file_name[1] && 0 == file_name[2]));
 }
 
+// **************************************** DirEnumParallel ****************************************
+
+class FileSystem_DirWalker
+{
+	typedef std::basic_string<FILE_PATH_CHAR> PathString;
+	struct DirTask;
+	typedef std::shared_ptr<DirTask> DirTaskPtr;
+	struct DirTask {
+		PathString Path; // with the separator at the end
+		FileEntry::FileInfo Info;
+		std::atomic<bool> Taken{ false }; // read by a thread (ordered: the calling thread may take it too)
+		// unordered
+		DirTaskPtr Parent;
+		std::atomic<unsigned> Pending{ 1 }; // own reading + the subdirectories which aren't done
+		// ordered
+		bool IsListed = false;
+		std::vector<FileSystem_DirItem> Items;
+		std::vector<DirTaskPtr> Subdirs; // in the Items order
+	};
+	struct WorkerQueue {
+		std::mutex Sync;
+		std::deque<DirTaskPtr> Tasks;
+	};
+
+	DirEnumItemProc itemProc;
+	const FILE_PATH_CHAR* fileMask;
+	DirEnumOptions options;
+	bool isOrdered;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::atomic<size_t> queuedCount, listedCount; // listedCount - ordered: read, not reported yet
+	std::atomic<bool> stopFlag, doneFlag;
+	std::mutex waitSync;
+	std::condition_variable workCond, listedCond;
+
+	void Notify(std::condition_variable& cond) {
+		{ std::lock_guard<std::mutex> sync_lock(waitSync); } // the waiting thread checks the state under the lock
+		cond.notify_all();
+	}
+	bool Report(const PathString& path, bool is_dir, const FileEntry::FileInfo& info) {
+		FileEntry file_item;
+		file_item.Path = path;
+		file_item.IsDir = is_dir;
+		file_item.Info = info;
+		if (itemProc(file_item)) return true;
+		stopFlag = true; // ERROR: interrupted
+		Notify(workCond);
+		Notify(listedCond);
+		return false;
+	}
+	void Push(unsigned worker, DirTaskPtr task);
+	DirTaskPtr Pop(unsigned worker);
+	void Read(unsigned worker, const DirTaskPtr& task, std::vector<FileSystem_DirItem>& items);
+	void Finish(DirTaskPtr task);
+	bool Emit(const DirTaskPtr& task, std::vector<FileSystem_DirItem>& items);
+	void WorkerProc(unsigned worker);
+public:
+	FileSystem_DirWalker(DirEnumItemProc item_proc, const FILE_PATH_CHAR* file_mask, DirEnumOptions opt, bool ordered)
+		: itemProc(item_proc), fileMask(file_mask), options(opt), isOrdered(ordered),
+		queuedCount(0), listedCount(0), stopFlag(false), doneFlag(false) { }
+	int Run(const FILE_PATH_CHAR* dir_path, unsigned thread_count);
+};
+
+void FileSystem_DirWalker::Push(unsigned worker, DirTaskPtr task)
+{
+	{
+		std::lock_guard<std::mutex> sync_lock(queues[worker]->Sync);
+		queues[worker]->Tasks.push_back(std::move(task));
+		++queuedCount;
+	}
+	{ std::lock_guard<std::mutex> sync_lock(waitSync); }
+	workCond.notify_one();
+}
+
+// Own newest task (depth first), then the oldest task of the other threads (the largest subtree probably)
+FileSystem_DirWalker::DirTaskPtr FileSystem_DirWalker::Pop(unsigned worker)
+{
+	for (size_t i = 0; i < queues.size(); ++i) {
+		WorkerQueue& queue = *queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> sync_lock(queue.Sync);
+		while (!queue.Tasks.empty()) {
+			DirTaskPtr task;
+			if (0 == i) {
+				task = std::move(queue.Tasks.back());
+				queue.Tasks.pop_back();
+			} else {
+				task = std::move(queue.Tasks.front());
+				queue.Tasks.pop_front();
+			}
+			--queuedCount;
+			if (!task->Taken.exchange(true)) return task;
+		}
+	}
+	return nullptr;
+}
+
+void FileSystem_DirWalker::Read(unsigned worker, const DirTaskPtr& task, std::vector<FileSystem_DirItem>& items)
+{
+	items.clear();
+	FileSystem_DirList(task->Path.c_str(), fileMask, options, items);
+	if (isOrdered) { // the items are reported by Emit
+		for (const auto& item : items) {
+			if (!item.IsDir) continue;
+			DirTaskPtr sub = std::make_shared<DirTask>();
+			sub->Path = task->Path + item.Name + (FILE_PATH_CHAR)FILE_PATH_SEPARATOR_CHR;
+			sub->Info = item.Info;
+			task->Subdirs.push_back(sub);
+		}
+		for (auto sub = task->Subdirs.rbegin(); sub != task->Subdirs.rend(); ++sub) Push(worker, *sub); // the first on top
+		++listedCount;
+		{
+			std::lock_guard<std::mutex> sync_lock(waitSync);
+			task->Items.swap(items);
+			task->IsListed = true;
+		}
+		listedCond.notify_all();
+		return;
+	}
+	PathString path;
+	for (const auto& item : items) {
+		if (stopFlag) break;
+		path = task->Path + item.Name;
+		if (!item.IsDir) {
+			if (!Report(path, false, item.Info)) break;
+			continue;
+		}
+		if ((deoDirFirst & options) && !Report(path, true, item.Info)) break;
+		DirTaskPtr sub = std::make_shared<DirTask>();
+		sub->Path = path + (FILE_PATH_CHAR)FILE_PATH_SEPARATOR_CHR;
+		sub->Info = item.Info;
+		sub->Parent = task;
+		++task->Pending;
+		Push(worker, std::move(sub));
+	}
+}
+
+// Unordered: the directory is read, reports deoDirLast of the directories which subtrees are done
+void FileSystem_DirWalker::Finish(DirTaskPtr task)
+{
+	while (1 == task->Pending.fetch_sub(1)) {
+		if (!task->Parent) { // the root
+			doneFlag = true;
+			Notify(workCond);
+			return;
+		}
+		if ((deoDirLast & options) && !stopFlag)
+			Report(task->Path.substr(0, task->Path.length() - 1), true, task->Info);
+		DirTaskPtr parent = std::move(task->Parent);
+		task = std::move(parent);
+	}
+}
+
+// Ordered: reports the directory items in the DirEnum order (reads the directory if no thread took it yet)
+bool FileSystem_DirWalker::Emit(const DirTaskPtr& task, std::vector<FileSystem_DirItem>& items)
+{
+	if (!task->Taken.exchange(true)) Read(0, task, items);
+	else {
+		std::unique_lock<std::mutex> sync_lock(waitSync);
+		listedCond.wait(sync_lock, [this, &task] { return task->IsListed || stopFlag; });
+	}
+	if (stopFlag) return false;
+	PathString path;
+	size_t sub_index = 0;
+	for (const auto& item : task->Items) {
+		path = task->Path + item.Name;
+		if (!item.IsDir) {
+			if (!Report(path, false, item.Info)) return false;
+			continue;
+		}
+		DirTaskPtr sub = std::move(task->Subdirs[sub_index++]); // released when reported
+		if ((deoDirFirst & options) && !Report(path, true, item.Info)) return false;
+		if (!Emit(sub, items)) return false;
+		if ((deoDirLast & options) && !Report(path, true, item.Info)) return false;
+	}
+	if (FILE_DIR_LIST_AHEAD == listedCount--) Notify(workCond);
+	return true;
+}
+
+void FileSystem_DirWalker::WorkerProc(unsigned worker)
+{
+	std::vector<FileSystem_DirItem> items;
+	while (!stopFlag && !doneFlag) {
+		DirTaskPtr task;
+		if (!isOrdered || listedCount < FILE_DIR_LIST_AHEAD) task = Pop(worker);
+		if (!task) {
+			std::unique_lock<std::mutex> sync_lock(waitSync);
+			workCond.wait(sync_lock, [this] {
+				return stopFlag || doneFlag || (queuedCount > 0 && (!isOrdered || listedCount < FILE_DIR_LIST_AHEAD));
+			});
+			continue;
+		}
+		Read(worker, task, items);
+		if (!isOrdered) Finish(std::move(task));
+	}
+}
+
+int FileSystem_DirWalker::Run(const FILE_PATH_CHAR* dir_path, unsigned thread_count)
+{
+	DirTaskPtr root = std::make_shared<DirTask>();
+	root->Path = dir_path;
+	if (root->Path.empty() || (FILE_PATH_CHAR)FILE_PATH_SEPARATOR_CHR != root->Path.back())
+		root->Path += (FILE_PATH_CHAR)FILE_PATH_SEPARATOR_CHR;
+	if (0 == thread_count) thread_count = std::thread::hardware_concurrency();
+	if (0 == thread_count) thread_count = 1;
+	for (unsigned i = 0; i < thread_count; ++i) queues.emplace_back(new WorkerQueue());
+	std::vector<std::thread> threads;
+	if (isOrdered) { // the calling thread reports the items
+		for (unsigned i = 0; i < thread_count; ++i) threads.emplace_back(&FileSystem_DirWalker::WorkerProc, this, i);
+		std::vector<FileSystem_DirItem> items;
+		Emit(root, items);
+		doneFlag = true;
+		Notify(workCond);
+	} else { // the calling thread is the worker 0
+		Push(0, root);
+		root.reset();
+		for (unsigned i = 1; i < thread_count; ++i) threads.emplace_back(&FileSystem_DirWalker::WorkerProc, this, i);
+		WorkerProc(0);
+	}
+	for (auto& thread : threads) thread.join();
+	return stopFlag ? -1 : 0; // ERROR: interrupted
+}
+
+int LisFileSys::DirEnumParallel(DirEnumItemProc item_proc, const FILE_PATH_CHAR* dir_path,
+	const FILE_PATH_CHAR* file_mask, DirEnumOptions options, unsigned thread_count, bool ordered)
+{
+	FileSystem_DirWalker walker(item_proc, file_mask, options, ordered);
+	return walker.Run(dir_path, thread_count);
+}
+
 int LisFileSys::DirFileListLoad(std::vector<FileEntry>& data,
 	const FILE_PATH_CHAR* dir_path, const FILE_PATH_CHAR* file_mask, bool recursive)
 {
@@ -39,15 +39,26 @@ struct FileEntry {
 typedef std::function<bool(const FileEntry& file)> DirEnumItemProc;
 
 enum DirEnumOptions {
-	deoRecursive = 1, deoFiles = 1 << 1, deoDirFirst = 1 << 2, deoDirLast = 1 << 3
+	deoRecursive = 1, deoFiles = 1 << 1, deoDirFirst = 1 << 2, deoDirLast = 1 << 3,
+	deoFileInfo = 1 << 4 // fill FileEntry::Info (Windows: always filled)
 };
 extern const DirEnumOptions DirEnumDefaultOptions; // deoFiles
 
 // DirEnum behaviour differs: file_mask is used for directories under Windows, not for other OSes;
-// file info (time, size) is retrieved under Windows only as for now.
+// file info (time, size) is retrieved under Windows always, under other OSes with deoFileInfo only
+// (the stat call per item, relative to the directory handle).
 int DirEnum(DirEnumItemProc item_proc, const FILE_PATH_CHAR* dir_path,
 	const FILE_PATH_CHAR* file_mask = NULL, DirEnumOptions options = DirEnumDefaultOptions);
 
+// Parallel recursive DirEnum for the large trees (deoRecursive is implied): the directories are read by
+// thread_count threads (0 - the hardware threads count), a thread takes the last subdirectory it found and
+// steals the oldest ones of the other threads when idle. item_proc is called concurrently from the threads,
+// ordered: from the calling thread in the DirEnum order (the directories are read ahead in parallel).
+// deoDirFirst / deoDirLast: the directory is reported before / after the items of its whole subtree.
+int DirEnumParallel(DirEnumItemProc item_proc, const FILE_PATH_CHAR* dir_path,
+	const FILE_PATH_CHAR* file_mask = NULL, DirEnumOptions options = DirEnumDefaultOptions,
+	unsigned thread_count = 0, bool ordered = false);
+
 int DirFileListLoad(std::vector<FileEntry>& data,
 	const FILE_PATH_CHAR* dir_path, const FILE_PATH_CHAR* file_mask = NULL, bool recursive = false);
 
@@ -61,6 +72,8 @@ bool FileRename(const FILE_PATH_CHAR* src_path, const FILE_PATH_CHAR* dst_path);
 
 bool FileDelete(const FILE_PATH_CHAR* file_path);
 
+bool FileTruncate(const FILE_PATH_CHAR* file_path, unsigned long long size);
+
 bool FileExistCheck(const FILE_PATH_CHAR* path);
 
 } // namespace LisFileSys
@@ -0,0 +1,377 @@
+// ****** Binary log (deferred formatting). (c) 2025 LISV ******
+#include "LogBinary.h"
+#include <atomic>
+#include <cstdio>
+
+namespace LisLog {
+
+const char BinLogSignature[8] = { 'L', 'I', 'S', 'B', 'L', 'O', 'G', '1' };
+
+unsigned BinLogFormat::RegisterFormat()
+{
+	static std::atomic<unsigned> format_count(0);
+	return format_count++;
+}
+
+// ******************************************* BinLogger *******************************************
+
+// Size of the existing file part with the complete records (the writer may be killed in the middle
+// of a record), 0 - no file or torn signature, -1 - not a binary log file
+static long long BinLog_ValidSize(const FILE_PATH_CHAR* file_path, long long& file_size)
+{
+	file_size = 0;
+	std::ifstream stm(file_path, std::ios_base::in | std::ios::binary | std::ios_base::ate);
+	if (!stm.is_open()) return 0;
+	file_size = (long long)stm.tellg();
+	stm.seekg(0);
+	char signature[sizeof(BinLogSignature)];
+	if (!stm.read(signature, sizeof(signature))) return 0;
+	if (0 != std::memcmp(signature, BinLogSignature, sizeof(signature))) return -1;
+	long long result = sizeof(BinLogSignature);
+	for (;;) {
+		char rec_type;
+		uint32_t id;
+		uint16_t len;
+		if (!stm.get(rec_type) || !stm.read((char*)&id, sizeof(id))) break;
+		size_t rec_size = 1 + sizeof(id) + sizeof(len);
+		if (blrEvent == rec_type) {
+			if (!stm.ignore(1 + sizeof(int64_t)) || stm.gcount() != 1 + sizeof(int64_t)) break;
+			rec_size += 1 + sizeof(int64_t);
+		} else if (blrFormat != rec_type) break;
+		if (!stm.read((char*)&len, sizeof(len))) break;
+		if (len && (!stm.ignore(len) || stm.gcount() != len)) break;
+		result += rec_size + len;
+	}
+	return result;
+}
+
+static std::atomic<uint64_t> BinLog_InstanceCount(0);
+
+BinLogger::BinLogger(const FILE_PATH_CHAR* file_path, LogLevel lvl, unsigned flush_period_ms)
+	: instanceId(++BinLog_InstanceCount), logLevel(lvl), status(-1), flushPeriod(flush_period_ms), flushStop(false)
+{
+	long long file_size, valid_size = BinLog_ValidSize(file_path, file_size);
+	if (valid_size < 0) return; // ERROR: not a binary log file
+	if (valid_size < file_size && !LisFileSys::FileTruncate(file_path, valid_size))
+		return; // ERROR: can't drop the incomplete record
+	bool is_new = 0 == valid_size;
+	fileStm.open(file_path, std::ios_base::out | std::ios::binary | std::ios_base::app);
+	if (is_new && fileStm.good()) fileStm.write(BinLogSignature, sizeof(BinLogSignature)).flush();
+	if (fileStm.good()) status = 0;
+	if (0 == status && flushPeriod > 0) FlushTaskStart();
+}
+
+BinLogger::~BinLogger()
+{
+	{
+		std::lock_guard<std::mutex> sync_lock(flushSync);
+		flushStop = true;
+		flushWake.notify_all();
+	}
+	flushTask.StopTask("flush");
+	Flush();
+}
+
+void BinLogger::FlushTaskStart()
+{
+	// The buffer of the thread logging rarely would wait for the next events to fill it
+	flushTask.StartTask("flush", [this](LisThread::TaskProcCtrl* proc_ctrl, LisThread::TaskWorkData work_data) {
+		std::unique_lock<std::mutex> sync_lock(flushSync);
+		while (!flushWake.wait_for(sync_lock, std::chrono::milliseconds(flushPeriod), [this] { return flushStop; })) {
+			sync_lock.unlock();
+			Flush();
+			sync_lock.lock();
+		}
+		return 0;
+	}, nullptr);
+}
+
+BinLogger::ThreadBuffer* BinLogger::GetThreadBuffer()
+{
+	// The thread's buffer of the last used logger; the buffers are owned by the logger and the thread,
+	// the logger releases the buffer no thread refers to
+	static thread_local struct { uint64_t LoggerId; std::shared_ptr<ThreadBuffer> Buffer; } thread_buf = { 0, nullptr };
+
+	if (instanceId != thread_buf.LoggerId) {
+		std::lock_guard<std::mutex> sync_lock(fileSync);
+		auto& buf = threadBuffers[std::this_thread::get_id()];
+		if (!buf) buf = std::make_shared<ThreadBuffer>();
+		thread_buf.LoggerId = instanceId;
+		thread_buf.Buffer = buf;
+	}
+	return thread_buf.Buffer.get();
+}
+
+bool BinLogger::Reserve(ThreadBuffer& buf, size_t len)
+{
+	if (0 != status.load(std::memory_order_relaxed) || len > BinLogBufferSize) return false;
+	if (buf.Used + len > buf.Size) {
+		BufferWrite(buf);
+		if (len > buf.Size) {
+			buf.Data.reset(new char[len]);
+			buf.Size = len;
+		}
+	}
+	return true;
+}
+
+void BinLogger::WriteFormat(ThreadBuffer& buf, const BinLogFormat& fmt)
+{
+	char* pos = buf.Data.get() + buf.Used;
+	uint32_t id = fmt.Id;
+	uint16_t len = fmt.Length;
+	*pos++ = (char)blrFormat;
+	std::memcpy(pos, &id, sizeof(id));  pos += sizeof(id);
+	std::memcpy(pos, &len, sizeof(len));  pos += sizeof(len);
+	std::memcpy(pos, fmt.Text, len);  pos += len;
+	buf.Used = pos - buf.Data.get();
+	if (fmt.Id >= buf.FormatsWritten.size()) buf.FormatsWritten.resize(fmt.Id + 1);
+	buf.FormatsWritten[fmt.Id] = true;
+}
+
+char* BinLogger::PutEventHeader(char* dst, const BinLogFormat& fmt, LogLevel lvl, size_t args_size)
+{
+	uint32_t id = fmt.Id;
+	int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	uint16_t size = (uint16_t)args_size;
+	*dst++ = (char)blrEvent;
+	std::memcpy(dst, &id, sizeof(id));  dst += sizeof(id);
+	*dst++ = (char)lvl;
+	std::memcpy(dst, &time, sizeof(time));  dst += sizeof(time);
+	std::memcpy(dst, &size, sizeof(size));  dst += sizeof(size);
+	return dst;
+}
+
+char* BinLogger::ArgPut(char* dst, const uint16_t*& str_len, const char* val)
+{
+	uint16_t len = *str_len++;
+	std::memcpy(dst, &len, sizeof(len));
+	if (len) std::memcpy(dst + sizeof(len), val, len);
+	return dst + sizeof(len) + len;
+}
+
+char* BinLogger::ArgPut(char* dst, const uint16_t*&, const std::string& val)
+{
+	uint16_t len = (uint16_t)std::min<size_t>(val.size(), 0xFFFF);
+	std::memcpy(dst, &len, sizeof(len));
+	std::memcpy(dst + sizeof(len), val.data(), len);
+	return dst + sizeof(len) + len;
+}
+
+void BinLogger::BufferWrite(ThreadBuffer& buf)
+{
+	if (0 == buf.Used) return;
+	std::lock_guard<std::mutex> sync_lock(fileSync);
+	if (0 == status.load(std::memory_order_relaxed)) {
+		fileStm.write(buf.Data.get(), buf.Used);
+		fileStm.flush();
+		if (fileStm.fail()) status = -2; // ERROR: write
+	}
+	buf.Used = 0;
+}
+
+void BinLogger::Flush()
+{
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	{
+		std::lock_guard<std::mutex> sync_lock(fileSync);
+		for (const auto& item : threadBuffers) buffers.push_back(item.second);
+	}
+	for (const auto& buf : buffers) { // the lock order is the thread's buffer, then the file
+		std::lock_guard<std::mutex> buf_lock(buf->Sync);
+		BufferWrite(*buf);
+	}
+	buffers.clear();
+
+	// Not referenced by the threads: the thread finished or switched to another logger
+	std::lock_guard<std::mutex> sync_lock(fileSync);
+	for (auto it = threadBuffers.begin(); it != threadBuffers.end(); ) {
+		ThreadBuffer& buf = *it->second;
+		bool is_unused = 1 == it->second.use_count() && buf.Sync.try_lock();
+		if (is_unused) {
+			is_unused = 0 == buf.Used;
+			buf.Sync.unlock();
+		}
+		if (is_unused) it = threadBuffers.erase(it);
+		else ++it;
+	}
+}
+
+// ***************************************** BinLogReader ******************************************
+
+template <typename T>
+static bool BinLog_Read(const char*& pos, const char* end, T& value)
+{
+	if (end - pos < (ptrdiff_t)sizeof(T)) return false;
+	std::memcpy(&value, pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+template <typename T>
+static void BinLog_AppendArg(std::string& text, const std::string& spec, const int* stars, int star_cnt, T value)
+{
+	char buf[0x100];
+	int len;
+	for (int pass = 0; pass < 2; ++pass) {
+		char* dst = pass ? &text[text.size() - len - 1] : buf;
+		size_t dst_len = pass ? len + 1 : sizeof(buf);
+		switch (star_cnt) {
+		case 0: len = std::snprintf(dst, dst_len, spec.c_str(), value); break;
+		case 1: len = std::snprintf(dst, dst_len, spec.c_str(), stars[0], value); break;
+		default: len = std::snprintf(dst, dst_len, spec.c_str(), stars[0], stars[1], value); break;
+		}
+		if (len < 0) return; // ERROR: format
+		if (pass) { text.pop_back(); return; }
+		if ((size_t)len < sizeof(buf)) { text.append(buf, len); return; }
+		text.resize(text.size() + len + 1); // too long for the local buffer, print directly to the text
+	}
+}
+
+BinLogReader::BinLogReader(const FILE_PATH_CHAR* file_path) : status(-1)
+{
+	fileStm.open(file_path, std::ios_base::in | std::ios::binary);
+	char signature[sizeof(BinLogSignature)];
+	if (fileStm.read(signature, sizeof(signature))
+		&& 0 == std::memcmp(signature, BinLogSignature, sizeof(signature)))
+		status = 0;
+}
+
+bool BinLogReader::RenderText(const std::string& fmt, const char* args, size_t args_size, std::string& text)
+{
+	const char* pos = args;
+	const char* end = args + args_size;
+	size_t i = 0, n = fmt.size();
+	text.clear();
+	while (i < n) {
+		if ('%' != fmt[i]) {
+			size_t next = fmt.find('%', i);
+			if (std::string::npos == next) next = n;
+			text.append(fmt, i, next - i);
+			i = next;
+			continue;
+		}
+		if (i + 1 < n && '%' == fmt[i + 1]) { text += '%'; i += 2; continue; }
+
+		// Conversion specification: %[flags][width][.precision][length]conversion
+		size_t start = i++;
+		int stars[2], star_cnt = 0;
+		int64_t value;
+		while (i < n && std::strchr("-+ #0'", fmt[i])) ++i;
+		for (int part = 0; part < 2 && i < n; ++part) { // width, then precision
+			if (1 == part) {
+				if ('.' != fmt[i]) break;
+				++i;
+			}
+			if (i < n && '*' == fmt[i]) {
+				if (!BinLog_Read(pos, end, value)) return false;
+				stars[star_cnt++] = (int)value;
+				++i;
+			} else while (i < n && fmt[i] >= '0' && fmt[i] <= '9') ++i;
+		}
+		size_t len_pos = i;
+		while (i < n && std::strchr("hljztLq", fmt[i])) ++i;
+		if (i >= n) return false; // ERROR: incomplete specification
+		std::string len_mod = fmt.substr(len_pos, i - len_pos);
+		char conv = fmt[i++];
+		std::string spec = fmt.substr(start, len_pos - start);
+		switch (conv) {
+		case 'd': case 'i':
+			if (!BinLog_Read(pos, end, value)) return false;
+			if ("hh" == len_mod) value = (signed char)value;
+			else if ("h" == len_mod) value = (short)value;
+			else if (len_mod.empty()) value = (int)value;
+			else if ("l" == len_mod) value = (long)value;
+			BinLog_AppendArg(text, spec + "ll" + conv, stars, star_cnt, (long long)value);
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			if (!BinLog_Read(pos, end, value)) return false;
+			if ("hh" == len_mod) value = (unsigned char)value;
+			else if ("h" == len_mod) value = (unsigned short)value;
+			else if (len_mod.empty()) value = (unsigned int)value;
+			else if ("l" == len_mod) value = (unsigned long)value;
+			BinLog_AppendArg(text, spec + "ll" + conv, stars, star_cnt, (unsigned long long)value);
+			break;
+		case 'c':
+			if (!BinLog_Read(pos, end, value)) return false;
+			BinLog_AppendArg(text, spec + conv, stars, star_cnt, (int)value);
+			break;
+		case 'p':
+			if (!BinLog_Read(pos, end, value)) return false;
+			BinLog_AppendArg(text, spec + conv, stars, star_cnt, (void*)(intptr_t)value);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+			double dbl;
+			if (!BinLog_Read(pos, end, dbl)) return false;
+			BinLog_AppendArg(text, spec + conv, stars, star_cnt, dbl);
+			break;
+		}
+		case 's': {
+			uint16_t len;
+			if (!BinLog_Read(pos, end, len) || end - pos < len) return false;
+			std::string str(pos, len);
+			pos += len;
+			BinLog_AppendArg(text, spec + conv, stars, star_cnt, str.c_str());
+			break;
+		}
+		case 'n':
+			if (!BinLog_Read(pos, end, value)) return false;
+			break;
+		default: // unknown conversion, keep as is
+			text.append(fmt, start, i - start);
+		}
+	}
+	return true;
+}
+
+bool BinLogReader::ReadEvent(LogLevel& lvl, std::chrono::system_clock::time_point& time, std::string& text)
+{
+	if (0 != status) return false;
+	for (;;) {
+		char rec_type;
+		if (!fileStm.get(rec_type)) return false; // end of file
+		uint32_t id;
+		uint16_t len;
+		if (!fileStm.read((char*)&id, sizeof(id))) break;
+		if (blrFormat == rec_type) {
+			if (!fileStm.read((char*)&len, sizeof(len))) break;
+			if (id >= formats.size()) formats.resize(id + 1);
+			formats[id].resize(len);
+			if (len && !fileStm.read(&formats[id][0], len)) break;
+		} else if (blrEvent == rec_type) {
+			char level;
+			int64_t time_ns;
+			if (!fileStm.get(level) || !fileStm.read((char*)&time_ns, sizeof(time_ns))
+				|| !fileStm.read((char*)&len, sizeof(len))) break;
+			argsBuf.resize(len);
+			if (len && !fileStm.read(argsBuf.data(), len)) break;
+			if (id >= formats.size() || level < 0 || level >= llNone
+				|| !RenderText(formats[id], argsBuf.data(), len, text)) break;
+			lvl = (LogLevel)level;
+			time = std::chrono::system_clock::time_point(std::chrono::duration_cast<
+				std::chrono::system_clock::duration>(std::chrono::nanoseconds(time_ns)));
+			return true;
+		} else break;
+	}
+	status = -2; // ERROR: data
+	return false;
+}
+
+long long BinLogReader::Decode(LogTargetBase& target)
+{
+	long long result = 0;
+	std::string text;
+	LogTargetBase::LogEvent evt;
+	evt.Type = LogTargetBase::etGeneral;
+	evt.Fields = nullptr;
+	while (ReadEvent(evt.Level, evt.Time, text)) {
+		evt.Data = text.c_str();
+		if (evt.Level >= target.logLevel) target.WriteEvent(evt);
+		++result;
+	}
+	target.Flush();
+	return result;
+}
+
+} // namespace LisLog
@@ -0,0 +1,183 @@
+// ****** Binary log (deferred formatting). (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_BINARY_H_
+#define _LIS_LOG_BINARY_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Logger.h"
+
+namespace LisLog {
+
+// The event is stored as format string id + raw argument values, the text is built by BinLogReader.
+// File layout: BinLogSignature, then records; every record starts with BinLogRecordType byte.
+//   blrFormat: uint32 id, uint16 length, format string chars (written before the first use of the id)
+//   blrEvent: uint32 format id, uint8 level, int64 time (ns since epoch), uint16 args size, args data
+// Argument values: integers, enums and pointers - 8 bytes, floating point - 8 bytes (double),
+//   strings - uint16 length + chars.
+// The existing file is appended; the incomplete last record (the writer was killed) is truncated on open.
+// Every thread buffers its records separately, so the events of the different threads are interleaved
+// by the buffer blocks (in order per thread, the format record precedes the thread's first use of it).
+// The buffers are written out when full, by Flush and by the logger's task every flush period, so
+// the crash of the process loses the events of the last flush period (up to the buffer size per thread).
+
+extern const char BinLogSignature[8];
+const size_t BinLogBufferSize = 0x20000; // enough for any record
+const size_t BinLogThreadBufferSize = 0x4000; // initial, grows up to the record size
+const unsigned BinLogFlushPeriodMs = 1000;
+enum BinLogRecordType { blrFormat = 'F', blrEvent = 'E' };
+
+// Format string registered once per call site (see LOG_BIN)
+class BinLogFormat
+{
+	static unsigned RegisterFormat();
+public:
+	const char* Text;
+	const uint16_t Length; // the text length in the format record
+	const unsigned Id;
+	explicit BinLogFormat(const char* text)
+		: Text(text), Length((uint16_t)std::min<size_t>(std::strlen(text), 0xFFFF)), Id(RegisterFormat()) { }
+};
+
+class BinLogger
+{
+	// Records of the thread, written to the file as a whole
+	struct ThreadBuffer {
+		std::mutex Sync; // the owner thread vs Flush, not contended
+		std::unique_ptr<char[]> Data;
+		size_t Size, Used;
+		std::vector<bool> FormatsWritten; // the format records written by the thread
+		ThreadBuffer() : Data(new char[BinLogThreadBufferSize]), Size(BinLogThreadBufferSize), Used(0) { }
+	};
+
+	const uint64_t instanceId; // the threads cache the buffer of the logger instance
+	LogLevel logLevel;
+	std::mutex fileSync; // the file writes and the thread buffers list
+	std::ofstream fileStm;
+	std::map<std::thread::id, std::shared_ptr<ThreadBuffer>> threadBuffers;
+	std::atomic<int> status;
+	unsigned flushPeriod; // milliseconds, 0 - no periodic flush
+	LisThread::ThreadTaskMgr flushTask;
+	std::mutex flushSync;
+	std::condition_variable flushWake;
+	bool flushStop;
+
+	ThreadBuffer* GetThreadBuffer();
+	bool Reserve(ThreadBuffer& buf, size_t len);
+	void WriteFormat(ThreadBuffer& buf, const BinLogFormat& fmt);
+	void BufferWrite(ThreadBuffer& buf); // buf.Sync must be locked
+	void FlushTaskStart();
+
+	// The C string lengths are measured once: ArgSize stores them, ArgPut takes them in the same order
+	static size_t ArgSize(uint16_t*& str_len, const char* val) {
+		*str_len = (uint16_t)std::min<size_t>(val ? std::strlen(val) : 0, 0xFFFF);
+		return 2 + *str_len++;
+	}
+	static size_t ArgSize(uint16_t*& str_len, char* val) { return ArgSize(str_len, (const char*)val); }
+	static size_t ArgSize(uint16_t*&, const std::string& val) { return 2 + std::min<size_t>(val.size(), 0xFFFF); }
+	template <typename T> static size_t ArgSize(uint16_t*&, const T&) { return 8; }
+
+	static char* ArgPut(char* dst, const uint16_t*& str_len, const char* val);
+	static char* ArgPut(char* dst, const uint16_t*& str_len, char* val) { return ArgPut(dst, str_len, (const char*)val); }
+	static char* ArgPut(char* dst, const uint16_t*&, const std::string& val);
+	template <typename T> static char* ArgPut(char* dst, const uint16_t*&, const T& val) {
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+			"unsupported binary log argument type");
+		return ArgPutValue(dst, val, std::is_floating_point<T>());
+	}
+	template <typename T> static char* ArgPutValue(char* dst, const T& val, std::true_type) {
+		double value = (double)val;
+		std::memcpy(dst, &value, 8);
+		return dst + 8;
+	}
+	template <typename T> static char* ArgPutValue(char* dst, const T& val, std::false_type) {
+		int64_t value = ArgToInt(val);
+		std::memcpy(dst, &value, 8);
+		return dst + 8;
+	}
+	template <typename T> static int64_t ArgToInt(T* val) { return (int64_t)(intptr_t)val; }
+	template <typename T> static int64_t ArgToInt(const T& val) { return (int64_t)val; }
+
+	static size_t ArgsSize(uint16_t*&) { return 0; }
+	template <typename T, typename... TArgs>
+	static size_t ArgsSize(uint16_t*& str_len, const T& val, const TArgs&... args) {
+		size_t size = ArgSize(str_len, val);
+		return size + ArgsSize(str_len, args...);
+	}
+	static char* ArgsPut(char* dst, const uint16_t*&) { return dst; }
+	template <typename T, typename... TArgs>
+	static char* ArgsPut(char* dst, const uint16_t*& str_len, const T& val, const TArgs&... args) {
+		dst = ArgPut(dst, str_len, val);
+		return ArgsPut(dst, str_len, args...);
+	}
+
+	static const size_t FormatHeaderSize = 1 + 4 + 2;
+	static const size_t EventHeaderSize = 1 + 4 + 1 + 8 + 2;
+	static char* PutEventHeader(char* dst, const BinLogFormat& fmt, LogLevel lvl, size_t args_size);
+public:
+	BinLogger(const FILE_PATH_CHAR* file_path, LogLevel lvl = llInfo, unsigned flush_period_ms = BinLogFlushPeriodMs);
+	~BinLogger();
+	int GetStatus() const { return status.load(std::memory_order_relaxed); }
+	bool IsLevelOn(LogLevel lvl) const { return (lvl >= logLevel) && (lvl < llNone); }
+
+	template <typename... TArgs>
+	void Log(LogLevel lvl, const BinLogFormat& fmt, const TArgs&... args)
+	{
+		uint16_t str_lens[sizeof...(TArgs) + 1];
+		uint16_t* str_len = str_lens;
+		size_t args_size = ArgsSize(str_len, args...);
+		if (args_size > 0xFFFF) return; // ERROR: too much data
+		ThreadBuffer* buf = GetThreadBuffer();
+		std::lock_guard<std::mutex> sync_lock(buf->Sync);
+		bool is_format_new = fmt.Id >= buf->FormatsWritten.size() || !buf->FormatsWritten[fmt.Id];
+		if (!Reserve(*buf, EventHeaderSize + args_size + (is_format_new ? FormatHeaderSize + fmt.Length : 0)))
+			return;
+		if (is_format_new) WriteFormat(*buf, fmt);
+		char* pos = PutEventHeader(buf->Data.get() + buf->Used, fmt, lvl, args_size);
+		const uint16_t* str_len_put = str_lens;
+		buf->Used = ArgsPut(pos, str_len_put, args...) - buf->Data.get();
+	}
+
+	// Writes out the buffers of all the threads, releases the ones of the finished threads
+	void Flush();
+};
+
+// The arguments are checked against the format at compile time (as by printf, so std::string is passed
+// as c_str()), the mismatch would be seen only by the decoder
+LIS_PRINTF_FMT(1, 2) inline void BinLogFormatCheck(const char* format, ...) { (void)format; }
+
+// Usage: LOG_BIN(bin_logger, llInfo, "%s: %d items, %.2f sec", name, count, seconds);
+#define LOG_BIN(logger, lvl, fmt, ...) do { \
+	if (false) LisLog::BinLogFormatCheck(fmt, ##__VA_ARGS__); \
+	static const LisLog::BinLogFormat lis_bin_log_fmt_(fmt); \
+	if ((logger).IsLevelOn(lvl)) (logger).Log(lvl, lis_bin_log_fmt_, ##__VA_ARGS__); \
+} while (0)
+
+// Decodes the binary log file, events text is the same as if they were logged by Logger
+class BinLogReader
+{
+	std::ifstream fileStm;
+	std::vector<std::string> formats;
+	std::vector<char> argsBuf;
+	int status;
+
+	bool RenderText(const std::string& fmt, const char* args, size_t args_size, std::string& text);
+public:
+	BinLogReader(const FILE_PATH_CHAR* file_path);
+	int GetStatus() const { return status; }
+
+	// Returns false at the end of file or on a data error (status < 0)
+	bool ReadEvent(LogLevel& lvl, std::chrono::system_clock::time_point& time, std::string& text);
+	// Writes all the (remaining) events to the target, returns count of events
+	long long Decode(LogTargetBase& target);
+};
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_BINARY_H_
@@ -0,0 +1,163 @@
+// ****** Logger events clock. (c) 2025 LISV ******
+#include "LogClock.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LIS_LOG_CLOCK_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace LisLog {
+
+const int TscCalibrationMs = 5; // initial rate measurement
+const int TscBaseMoveMinMs = 50, TscBaseMoveMaxMs = 1000; // the base move period doubles (the rate becomes precise)
+
+static int64_t LogSystemNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static int64_t LogSteadyNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t LogTscRead()
+{
+#ifdef LIS_LOG_CLOCK_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// TSC runs at the constant rate in all power states and is synchronized between cores
+static bool LogTscInvariant()
+{
+#if defined(LIS_LOG_CLOCK_TSC) && defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0x80000000);
+	if ((unsigned)regs[0] < 0x80000007) return false;
+	__cpuid(regs, 0x80000007);
+	return 0 != (regs[3] & (1 << 8));
+#elif defined(LIS_LOG_CLOCK_TSC)
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+	return 0 != (edx & (1 << 8));
+#else
+	return false;
+#endif
+}
+
+// **************************************** LogTscConverter ****************************************
+
+// TSC conversion: ns = baseNs + (tsc - baseTsc) * nsPerTick, the base is moved to the current
+// system time periodically (readers use the sequence lock); the rate is measured on the steady clock
+// since the calibration. One per process, calibrated when the first lctTsc clock is created.
+class LogTscConverter
+{
+	std::atomic<unsigned> convSeq;
+	std::atomic<uint64_t> baseTsc, nextBaseTsc;
+	std::atomic<int64_t> baseNs;
+	std::atomic<double> nsPerTick;
+	uint64_t calibTsc;
+	int64_t calibSteadyNs;
+	int baseMoveMs;
+	std::mutex baseSync;
+
+	LogTscConverter();
+	void MoveBase();
+public:
+	static LogTscConverter& Instance() {
+		static LogTscConverter converter;
+		return converter;
+	}
+	int64_t ToNs(uint64_t stamp);
+};
+
+LogTscConverter::LogTscConverter() : convSeq(0), baseTsc(0), nextBaseTsc(0), baseNs(0), nsPerTick(1.0),
+	calibTsc(LogTscRead()), calibSteadyNs(LogSteadyNs()), baseMoveMs(TscBaseMoveMinMs)
+{
+	int64_t steady_ns;
+	do {
+		std::this_thread::yield();
+		steady_ns = LogSteadyNs();
+	} while (steady_ns - calibSteadyNs < TscCalibrationMs * 1000000LL);
+	uint64_t tsc = LogTscRead();
+	nsPerTick = (double)(steady_ns - calibSteadyNs) / (double)(tsc - calibTsc);
+	baseNs = LogSystemNs();
+	baseTsc = LogTscRead();
+	nextBaseTsc = baseTsc + (uint64_t)(baseMoveMs * 1000000LL / nsPerTick);
+}
+
+void LogTscConverter::MoveBase()
+{
+	std::unique_lock<std::mutex> sync_lock(baseSync, std::try_to_lock);
+	if (!sync_lock) return; // moved by another thread
+	uint64_t tsc = LogTscRead();
+	if (tsc < nextBaseTsc.load(std::memory_order_relaxed)) return;
+	int64_t system_ns = LogSystemNs();
+	double rate = (double)(LogSteadyNs() - calibSteadyNs) / (double)(tsc - calibTsc); // the long baseline
+	unsigned seq = convSeq.load(std::memory_order_relaxed);
+	convSeq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	baseTsc.store(tsc, std::memory_order_relaxed);
+	baseNs.store(system_ns, std::memory_order_relaxed);
+	nsPerTick.store(rate, std::memory_order_relaxed);
+	convSeq.store(seq + 2, std::memory_order_release);
+	baseMoveMs = std::min(baseMoveMs * 2, TscBaseMoveMaxMs);
+	nextBaseTsc.store(tsc + (uint64_t)(baseMoveMs * 1000000LL / rate), std::memory_order_relaxed);
+}
+
+int64_t LogTscConverter::ToNs(uint64_t stamp)
+{
+	if (stamp >= nextBaseTsc.load(std::memory_order_relaxed)) MoveBase();
+	uint64_t base_tsc;
+	int64_t base_ns;
+	double rate;
+	for (;;) {
+		unsigned seq = convSeq.load(std::memory_order_acquire);
+		base_tsc = baseTsc.load(std::memory_order_relaxed);
+		base_ns = baseNs.load(std::memory_order_relaxed);
+		rate = nsPerTick.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (0 == (seq & 1) && convSeq.load(std::memory_order_relaxed) == seq) break;
+		std::this_thread::yield();
+	}
+	return base_ns + (int64_t)((double)(int64_t)(stamp - base_tsc) * rate);
+}
+
+// ******************************************* LogClock ********************************************
+
+LogClock::LogClock(LogClockType type) : clockType(type)
+{
+	if (lctTsc == clockType && !LogTscInvariant()) clockType = lctCoarse;
+#ifndef CLOCK_REALTIME_COARSE
+	if (lctCoarse == clockType) clockType = lctSystem;
+#endif
+	if (lctTsc == clockType) LogTscConverter::Instance(); // calibrated by the first clock
+}
+
+uint64_t LogClock::TscStamp()
+{
+	return LogTscRead();
+}
+
+std::chrono::system_clock::time_point LogClock::ToTime(uint64_t stamp) const
+{
+	int64_t ns = (lctTsc != clockType) ? (int64_t)stamp : LogTscConverter::Instance().ToNs(stamp);
+	return std::chrono::system_clock::time_point(
+		std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+} // namespace LisLog
@@ -0,0 +1,55 @@
+// ****** Logger events clock. (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_CLOCK_H_
+#define _LIS_LOG_CLOCK_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+namespace LisLog {
+
+enum LogClockType {
+	lctSystem, // std::chrono::system_clock
+	lctCoarse, // CLOCK_REALTIME_COARSE (resolution of the timer tick, 1-4 ms); lctSystem if not supported
+	lctTsc // CPU time stamp counter calibrated against the system clock; lctCoarse if there's no invariant TSC
+};
+
+// Event time source: the logging thread takes the cheap stamp, the stamp is converted to the wall time
+// later by the async thread in the async mode; in the sync mode the logging thread converts it at once
+// (the targets get the time), so lctTsc saves the time of the logging threads in the async mode only.
+// Stamp: ns since epoch, or TSC ticks for lctTsc (the conversion is shared by the clocks of the process,
+// the TSC rate is calibrated once by the first lctTsc clock).
+class LogClock
+{
+	LogClockType clockType;
+
+	static uint64_t TscStamp();
+public:
+	explicit LogClock(LogClockType type = lctSystem);
+	LogClock(const LogClock&) = delete;
+	LogClock& operator=(const LogClock&) = delete;
+
+	LogClockType GetType() const { return clockType; } // the type actually used
+
+	uint64_t Stamp() const {
+		switch (clockType) {
+		case lctTsc: return TscStamp();
+#ifdef CLOCK_REALTIME_COARSE
+		case lctCoarse: {
+			timespec ts;
+			clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+			return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		}
+#endif
+		default: return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	std::chrono::system_clock::time_point ToTime(uint64_t stamp) const;
+};
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_CLOCK_H_
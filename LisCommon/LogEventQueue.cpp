@@ -0,0 +1,192 @@
+// ****** Logger events queue (async mode). (c) 2025 LISV ******
+#include "LogEventQueue.h"
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace LisLog {
+
+// ************************************** LogEventQueue::Item **************************************
+
+bool LogEventQueue::Item::Assign(LogTargetBase::EventType typ, LogLevel lvl,
+	uint64_t stamp, const char* txt, const char* fields)
+{
+	Type = typ;
+	Level = lvl;
+	Stamp = stamp;
+	size_t txt_len = std::strlen(txt) + 1, fields_len = fields ? std::strlen(fields) + 1 : 0;
+	Size = txt_len + fields_len;
+	Data = (Size <= sizeof(Text)) ? Text : (char*)std::malloc(Size);
+	Fields = nullptr;
+	if (Data) {
+		std::memcpy(Data, txt, txt_len);
+		if (fields) {
+			Fields = Data + txt_len;
+			std::memcpy(Fields, fields, fields_len);
+		}
+	}
+	return nullptr != Data;
+}
+
+void LogEventQueue::Item::MoveTo(Item& dst)
+{
+	dst.Reset();
+	dst.Type = Type;
+	dst.Level = Level;
+	dst.Stamp = Stamp;
+	dst.Size = Size;
+	if (Data == Text) {
+		std::memcpy(dst.Text, Text, Size);
+		dst.Data = dst.Text;
+	} else dst.Data = Data; // take the heap copy ownership
+	dst.Fields = Fields ? dst.Data + (Fields - Data) : nullptr;
+	Data = nullptr;
+	Fields = nullptr;
+}
+
+void LogEventQueue::Item::Reset()
+{
+	if (Data && Data != Text) std::free(Data);
+	Data = nullptr;
+	Fields = nullptr;
+}
+
+// ***************************************** LogEventQueue *****************************************
+
+LogEventQueue::LogEventQueue(size_t capacity, LogOverflowPolicy policy)
+	: overflowPolicy(policy), enqueuePos(0), dequeuePos(0),
+	cntPushed(0), cntDropNewest(0), cntDropOldest(0), cntDropNoMemory(0), cntBlocked(0),
+	consumerIdle(false), consumerWakeFlag(false), producersWaiting(0)
+{
+	size_t size = 2;
+	while (size < capacity) size <<= 1;
+	cellMask = size - 1;
+	cells = new Cell[size];
+	for (size_t i = 0; i < size; ++i) cells[i].Seq.store(i, std::memory_order_relaxed);
+}
+
+LogEventQueue::~LogEventQueue()
+{
+	delete[] cells;
+}
+
+bool LogEventQueue::TryPush(LogTargetBase::EventType typ, LogLevel lvl,
+	uint64_t stamp, const char* txt, const char* fields)
+{
+	Cell* cell;
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &cells[pos & cellMask];
+		size_t seq = cell->Seq.load(std::memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+		if (0 == dif) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		} else if (dif < 0) return false; // the queue is full
+		else pos = enqueuePos.load(std::memory_order_relaxed);
+	}
+	if (!cell->Value.Assign(typ, lvl, stamp, txt, fields)) // ERROR: no memory, the consumer skips the item
+		cntDropNoMemory.fetch_add(1, std::memory_order_relaxed);
+	cell->Seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool LogEventQueue::Pop(Item& item)
+{
+	Cell* cell;
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &cells[pos & cellMask];
+		size_t seq = cell->Seq.load(std::memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (0 == dif) {
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		} else if (dif < 0) return false; // the queue is empty
+		else pos = dequeuePos.load(std::memory_order_relaxed);
+	}
+	cell->Value.MoveTo(item);
+	cell->Seq.store(pos + cellMask + 1, std::memory_order_release);
+	return true;
+}
+
+bool LogEventQueue::Push(LogTargetBase::EventType typ, LogLevel lvl,
+	uint64_t stamp, const char* txt, const char* fields)
+{
+	bool result = TryPush(typ, lvl, stamp, txt, fields);
+	if (!result) {
+		switch (overflowPolicy) {
+		case lopBlock: {
+			cntBlocked.fetch_add(1, std::memory_order_relaxed);
+			std::unique_lock<std::mutex> sync_lock(producerSync);
+			producersWaiting.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in SpaceFreed
+			while (!(result = TryPush(typ, lvl, stamp, txt, fields))) {
+				Wake();
+				producerWake.wait(sync_lock);
+			}
+			producersWaiting.fetch_sub(1, std::memory_order_relaxed);
+			break;
+		}
+		case lopDropOldest: {
+			static thread_local Item dropped;
+			do {
+				if (Pop(dropped)) {
+					dropped.Reset();
+					cntDropOldest.fetch_add(1, std::memory_order_relaxed);
+				}
+			} while (!(result = TryPush(typ, lvl, stamp, txt, fields)));
+			break;
+		}
+		default: // lopDropNewest
+			cntDropNewest.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	cntPushed.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in WaitItems
+	if (consumerIdle.load(std::memory_order_relaxed)) Wake();
+	return result;
+}
+
+bool LogEventQueue::IsEmpty() const
+{
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	size_t seq = cells[pos & cellMask].Seq.load(std::memory_order_acquire);
+	return (intptr_t)seq - (intptr_t)(pos + 1) < 0;
+}
+
+void LogEventQueue::GetStats(LogQueueStats& stats) const
+{
+	stats.Pushed = cntPushed.load(std::memory_order_relaxed);
+	stats.DroppedNewest = cntDropNewest.load(std::memory_order_relaxed);
+	stats.DroppedOldest = cntDropOldest.load(std::memory_order_relaxed);
+	stats.DroppedNoMemory = cntDropNoMemory.load(std::memory_order_relaxed);
+	stats.Blocked = cntBlocked.load(std::memory_order_relaxed);
+}
+
+void LogEventQueue::WaitItems(int wait_time_ms)
+{
+	std::unique_lock<std::mutex> sync_lock(consumerSync);
+	consumerIdle.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in Push
+	if (!consumerWakeFlag && IsEmpty())
+		consumerWake.wait_for(sync_lock, std::chrono::milliseconds(wait_time_ms));
+	consumerWakeFlag = false;
+	consumerIdle.store(false, std::memory_order_relaxed);
+}
+
+void LogEventQueue::Wake()
+{
+	std::lock_guard<std::mutex> sync_lock(consumerSync);
+	consumerWakeFlag = true;
+	consumerWake.notify_one();
+}
+
+void LogEventQueue::SpaceFreed()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst); // the popped cells are seen by the producer checking after
+	if (0 == producersWaiting.load(std::memory_order_relaxed)) return;
+	std::lock_guard<std::mutex> sync_lock(producerSync);
+	producerWake.notify_all();
+}
+
+} // namespace LisLog
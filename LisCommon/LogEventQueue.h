@@ -0,0 +1,88 @@
+// ****** Logger events queue (async mode). (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_EVENT_QUEUE_H_
+#define _LIS_LOG_EVENT_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "Logger.h"
+
+namespace LisLog {
+
+// Bounded lock-free multi-producer queue of the log events (sequence-per-cell ring).
+// Producers are any logging threads, the consumer is the logger's background thread;
+// with lopDropOldest policy producers may also consume (discard) the oldest items,
+// with lopBlock the producers wait for the free place until the consumer calls SpaceFreed.
+class LogEventQueue
+{
+public:
+	static const size_t ItemTextInlineLen = 0xE8; // longer texts are copied to the heap
+	static const size_t CacheLineSize = 64; // padding to avoid false sharing of the positions
+
+	struct Item {
+		LogTargetBase::EventType Type;
+		LogLevel Level;
+		uint64_t Stamp; // LogClock stamp, converted to the time by the consumer
+		char* Data; // points to Text or to heap allocated copy
+		char* Fields; // structured fields (stored after Data text) or nullptr
+		size_t Size; // Data size (including the fields)
+		char Text[ItemTextInlineLen];
+
+		Item() : Data(nullptr), Fields(nullptr), Size(0) { }
+		~Item() { Reset(); }
+		bool Assign(LogTargetBase::EventType typ, LogLevel lvl, // false - no memory for the text
+			uint64_t stamp, const char* txt, const char* fields);
+		void MoveTo(Item& dst);
+		void Reset();
+	};
+
+	LogEventQueue(size_t capacity, LogOverflowPolicy policy);
+	~LogEventQueue();
+
+	bool Push(LogTargetBase::EventType typ, LogLevel lvl,
+		uint64_t stamp, const char* txt, const char* fields);
+	bool Pop(Item& item);
+	bool IsEmpty() const;
+	// Positions to deliver the events claimed up to the moment (flush, stop): the claimed events
+	// may be not published yet, so IsEmpty is not enough
+	size_t GetClaimedPos() const { return enqueuePos.load(std::memory_order_acquire); }
+	bool IsConsumed(size_t pos) const { return (intptr_t)(dequeuePos.load(std::memory_order_acquire) - pos) >= 0; }
+	void GetStats(LogQueueStats& stats) const;
+
+	// Consumer side waiting, producers wake it up only if it's idle
+	void WaitItems(int wait_time_ms);
+	void Wake();
+	void SpaceFreed(); // the consumer popped the items: wakes the blocked producers
+private:
+	struct Cell {
+		std::atomic<size_t> Seq;
+		Item Value;
+	};
+
+	Cell* cells;
+	size_t cellMask;
+	LogOverflowPolicy overflowPolicy;
+	char padding0[CacheLineSize];
+	std::atomic<size_t> enqueuePos;
+	char padding1[CacheLineSize - sizeof(size_t)];
+	std::atomic<size_t> dequeuePos;
+	char padding2[CacheLineSize - sizeof(size_t)];
+	std::atomic<uint64_t> cntPushed, cntDropNewest, cntDropOldest, cntDropNoMemory, cntBlocked;
+	char padding3[CacheLineSize];
+
+	std::atomic<bool> consumerIdle;
+	bool consumerWakeFlag;
+	std::mutex consumerSync;
+	std::condition_variable consumerWake;
+	std::atomic<unsigned> producersWaiting; // lopBlock producers waiting for the free place
+	std::mutex producerSync;
+	std::condition_variable producerWake;
+
+	bool TryPush(LogTargetBase::EventType typ, LogLevel lvl,
+		uint64_t stamp, const char* txt, const char* fields);
+};
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_EVENT_QUEUE_H_
@@ -0,0 +1,277 @@
+// ****** Text log files reader (time range queries). (c) 2025 LISV ******
+#include "LogFileReader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "LogSimd.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LisLog {
+
+extern const char* LogLvlStr[LogLevel::llNone];
+
+const char LogIndexSignature[8] = { 'L', 'I', 'S', 'L', 'I', 'D', 'X', '1' };
+const size_t LogTimeTextLen = 23; // "YYYY-MM-DD HH:MM:SS.mmm"
+const size_t LogEventPrefixLen = LogTimeTextLen + 6; // + " [lvl]"
+
+static const char LogTimePattern[] = "0000-00-00 00:00:00.000"; // '0' - digit
+static const char LogTimeLowest[] = "0000-01-01 00:00:00.000";
+static const char LogTimeHighest[] = "9999-12-31 23:59:59.999";
+
+uint64_t LogTimeKey(const char* txt, size_t len)
+{
+	if (len < LogTimeTextLen) return 0;
+	uint64_t key = 0;
+	for (size_t i = 0; i < LogTimeTextLen; ++i) {
+		if ('0' == LogTimePattern[i]) {
+			unsigned digit = (unsigned)(unsigned char)txt[i] - '0';
+			if (digit > 9) return 0;
+			key = key * 10 + digit;
+		} else if (txt[i] != LogTimePattern[i]) return 0;
+	}
+	return key;
+}
+
+uint64_t LogTimeKeyParse(const char* txt, bool is_end)
+{
+	char buf[LogTimeTextLen + 1];
+	size_t len = std::strlen(txt);
+	if (len > LogTimeTextLen) return 0;
+	std::memcpy(buf, is_end ? LogTimeHighest : LogTimeLowest, sizeof(buf));
+	std::memcpy(buf, txt, len);
+	return LogTimeKey(buf, LogTimeTextLen);
+}
+
+// '\n' search by 32 bytes; returns end if not found
+static const char* LogFindNewline(const char* pos, const char* end)
+{
+#ifdef LIS_LOG_SSE2
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; end - pos >= 32; pos += 32) {
+		__m128i chunk1 = _mm_loadu_si128((const __m128i*)pos);
+		__m128i chunk2 = _mm_loadu_si128((const __m128i*)(pos + 16));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk1, newline))
+			| ((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk2, newline)) << 16);
+		if (mask) return pos + LogLowestBit(mask);
+	}
+#endif
+	const char* found = (const char*)std::memchr(pos, '\n', end - pos);
+	return found ? found : end;
+}
+
+// ***************************************** LogFileReader *****************************************
+
+#ifdef _WINDOWS
+
+bool LogFileReader::Open(const FILE_PATH_CHAR* file_path)
+{
+	Close();
+	HANDLE file = CreateFile(file_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == file) return false; // ERROR: can't open the file
+	fileHandle = (intptr_t)file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		Close();
+		return false;
+	}
+	if (0 == size.QuadPart) return true; // nothing to map
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) { // ERROR: mapping
+		Close();
+		return false;
+	}
+	mapHandle = (intptr_t)mapping;
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)size.QuadPart);
+	if (!view) { // ERROR: mapping
+		Close();
+		return false;
+	}
+	data = (const char*)view;
+	dataSize = (size_t)size.QuadPart;
+	return true;
+}
+
+void LogFileReader::Close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapHandle >= 0) CloseHandle((HANDLE)mapHandle);
+	if (fileHandle >= 0) CloseHandle((HANDLE)fileHandle);
+	data = nullptr;
+	dataSize = 0;
+	mapHandle = fileHandle = -1;
+	index.clear();
+	indexedSize = 0;
+}
+
+#else
+
+bool LogFileReader::Open(const FILE_PATH_CHAR* file_path)
+{
+	Close();
+	int file = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (file < 0) return false; // ERROR: can't open the file
+	fileHandle = file;
+	struct stat info;
+	if (0 != fstat(file, &info)) {
+		Close();
+		return false;
+	}
+	if (0 == info.st_size) return true; // nothing to map
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	if (MAP_FAILED == view) { // ERROR: mapping
+		Close();
+		return false;
+	}
+	data = (const char*)view;
+	dataSize = (size_t)info.st_size;
+	return true;
+}
+
+void LogFileReader::Close()
+{
+	if (data) munmap((void*)data, dataSize);
+	if (fileHandle >= 0) close((int)fileHandle);
+	data = nullptr;
+	dataSize = 0;
+	fileHandle = -1;
+	index.clear();
+	indexedSize = 0;
+}
+
+#endif
+
+size_t LogFileReader::LineNext(size_t pos) const
+{
+	const char* found = LogFindNewline(data + pos, data + dataSize);
+	return (found < data + dataSize) ? found - data + 1 : dataSize;
+}
+
+bool LogFileReader::IsEventStart(size_t pos) const
+{
+	return dataSize - pos >= LogEventPrefixLen && ' ' == data[pos + LogTimeTextLen]
+		&& '[' == data[pos + LogTimeTextLen + 1] && ']' == data[pos + LogTimeTextLen + 5] && 0 != EventTimeKey(pos);
+}
+
+size_t LogFileReader::EventNext(size_t pos) const
+{
+	while (pos < dataSize && !IsEventStart(pos)) pos = LineNext(pos);
+	return pos;
+}
+
+// The 3 chars of the level tag as the number (compared at once)
+static inline uint32_t LogLvlTagKey(const char* tag)
+{
+	return (uint32_t)(unsigned char)tag[0] | ((uint32_t)(unsigned char)tag[1] << 8)
+		| ((uint32_t)(unsigned char)tag[2] << 16);
+}
+
+LogLevel LogFileReader::EventLevel(size_t pos) const
+{
+	static const struct LvlTagKeys {
+		uint32_t Key[llNone];
+		LvlTagKeys() { for (int lvl = 0; lvl < llNone; ++lvl) Key[lvl] = LogLvlTagKey(LogLvlStr[lvl]); }
+	} lvl_keys;
+	uint32_t key = LogLvlTagKey(data + pos + LogTimeTextLen + 2);
+	for (int lvl = 0; lvl < llNone; ++lvl) {
+		if (key == lvl_keys.Key[lvl]) return (LogLevel)lvl;
+	}
+	return llNone;
+}
+
+size_t LogFileReader::FindTime(uint64_t time_key) const
+{
+	// Searches the lowest position which next event has the time >= time_key
+	size_t lo = 0, hi = dataSize;
+	if (!index.empty()) {
+		auto it = std::lower_bound(index.begin(), index.end(), time_key,
+			[](const LogIndexEntry& entry, uint64_t key) { return entry.TimeKey < key; });
+		if (it != index.end()) hi = (size_t)it->Offset;
+		if (it != index.begin()) lo = (size_t)(it - 1)->Offset + 1;
+	}
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		size_t pos = EventNext(LineStart(mid));
+		if (pos >= dataSize || EventTimeKey(pos) >= time_key) hi = mid;
+		else lo = pos + 1; // the positions up to pos have the same next event
+	}
+	return EventNext(LineStart(lo));
+}
+
+long long LogFileReader::Query(uint64_t from_key, uint64_t to_key, unsigned level_mask, EventProc proc) const
+{
+	long long count = 0;
+	size_t pos = FindTime(from_key);
+	while (pos < dataSize) {
+		if (EventTimeKey(pos) > to_key) break;
+		size_t next = EventNext(LineNext(pos));
+		LogLevel lvl = EventLevel(pos);
+		if (llNone != lvl && 0 != (level_mask & LogLvlMask(lvl))) {
+			++count;
+			if (!proc(lvl, data + pos, next - pos)) break;
+		}
+		pos = next;
+	}
+	return count;
+}
+
+size_t LogFileReader::BuildIndex(size_t step)
+{
+	index.clear();
+	if (0 == step) step = LogIndexStepDefault;
+	for (size_t pos = EventNext(0); pos < dataSize; pos = EventNext(LineStart(std::min(pos + step, dataSize)))) {
+		LogIndexEntry entry = { EventTimeKey(pos), pos };
+		index.push_back(entry);
+	}
+	indexedSize = dataSize;
+	return index.size();
+}
+
+// Index file: LogIndexSignature, uint64 indexed file size, uint64 entries count, LogIndexEntry array
+bool LogFileReader::SaveIndex(const FILE_PATH_CHAR* index_path) const
+{
+	std::ofstream file_stm(index_path, std::ios_base::out | std::ios::binary | std::ios_base::trunc);
+	if (!file_stm) return false; // ERROR: can't create the file
+	uint64_t count = index.size();
+	file_stm.write(LogIndexSignature, sizeof(LogIndexSignature));
+	file_stm.write((const char*)&indexedSize, sizeof(indexedSize));
+	file_stm.write((const char*)&count, sizeof(count));
+	if (count) file_stm.write((const char*)index.data(), count * sizeof(LogIndexEntry));
+	return !file_stm.fail();
+}
+
+bool LogFileReader::LoadIndex(const FILE_PATH_CHAR* index_path)
+{
+	std::ifstream file_stm(index_path, std::ios_base::in | std::ios::binary);
+	if (!file_stm) return false; // ERROR: can't open the file
+	char signature[sizeof(LogIndexSignature)];
+	uint64_t file_size = 0, count = 0;
+	file_stm.read(signature, sizeof(signature));
+	file_stm.read((char*)&file_size, sizeof(file_size));
+	file_stm.read((char*)&count, sizeof(count));
+	if (file_stm.fail() || 0 != std::memcmp(signature, LogIndexSignature, sizeof(signature))
+		|| file_size > dataSize || count > file_size)
+		return false; // ERROR: not an index or not of this file
+	std::vector<LogIndexEntry> entries((size_t)count);
+	if (count) file_stm.read((char*)entries.data(), count * sizeof(LogIndexEntry));
+	if (file_stm.fail()) return false; // ERROR: truncated
+	auto is_valid = [this, file_size](const LogIndexEntry& entry) {
+		return entry.Offset < file_size && IsEventStart((size_t)entry.Offset)
+			&& EventTimeKey((size_t)entry.Offset) == entry.TimeKey;
+	};
+	if (count && (!is_valid(entries.front()) || !is_valid(entries.back())))
+		return false; // ERROR: not of this file (replaced)
+	index.swap(entries);
+	indexedSize = file_size;
+	return true;
+}
+
+} // namespace LisLog
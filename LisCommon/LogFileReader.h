@@ -0,0 +1,85 @@
+// ****** Text log files reader (time range queries). (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_FILE_READER_H_
+#define _LIS_LOG_FILE_READER_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Logger.h"
+
+namespace LisLog {
+
+// Time key: the event time text "YYYY-MM-DD HH:MM:SS.mmm" as the number YYYYMMDDHHMMSSmmm,
+// the keys compare as the times do. 0 - not a time text.
+uint64_t LogTimeKey(const char* txt, size_t len);
+
+// Time key of the user given time "YYYY-MM-DD[ HH[:MM[:SS[.mmm]]]]", the missing parts are the lowest
+// values (is_end: the highest, "2025-03-01" - till 2025-03-01 23:59:59.999). 0 - wrong time text.
+uint64_t LogTimeKeyParse(const char* txt, bool is_end);
+
+inline unsigned LogLvlMask(LogLevel lvl) { return 1u << lvl; }
+const unsigned LogLvlMaskAll = (1u << llNone) - 1;
+
+const size_t LogIndexStepDefault = 0x10000; // file bytes per the side index entry
+
+struct LogIndexEntry
+{
+	uint64_t TimeKey;
+	uint64_t Offset; // the event line start
+};
+
+// ***************************************** LogFileReader *****************************************
+
+// Memory-maps the text log file (LogTargetTextFile format: "<time> [<lvl>] <text>" lines, the lines without
+// the time prefix continue the previous event, e.g. hex dump) and finds the events by the binary search
+// over the file bytes (the events are expected in the time order). The optional sparse side index
+// (time key -> offset every LogIndexStepDefault bytes) narrows the search to one index step.
+// The lines are scanned for '\n' by SSE2 (LIS_LOG_SSE2); the level filter compares the 3 chars tag of
+// the event as one number (too short for SIMD to help).
+// The file being written can be read, the events appended after Open aren't seen.
+class LogFileReader
+{
+	const char* data;
+	size_t dataSize;
+	intptr_t fileHandle, mapHandle;
+	std::vector<LogIndexEntry> index;
+	uint64_t indexedSize; // the file size covered by the index
+
+	size_t LineNext(size_t pos) const; // the next line start after pos (dataSize at the end)
+	size_t LineStart(size_t pos) const { return (0 == pos || '\n' == data[pos - 1]) ? pos : LineNext(pos); }
+	bool IsEventStart(size_t pos) const;
+	size_t EventNext(size_t pos) const; // the first event start at or after the line start pos
+	uint64_t EventTimeKey(size_t pos) const { return LogTimeKey(data + pos, dataSize - pos); }
+	LogLevel EventLevel(size_t pos) const;
+public:
+	// The event text (including the continuation lines and the last '\n'); false - stop
+	typedef std::function<bool(LogLevel lvl, const char* txt, size_t len)> EventProc;
+
+	LogFileReader() : data(nullptr), dataSize(0), fileHandle(-1), mapHandle(-1), indexedSize(0) { }
+	LogFileReader(const LogFileReader&) = delete;
+	LogFileReader& operator=(const LogFileReader&) = delete;
+	~LogFileReader() { Close(); }
+
+	bool Open(const FILE_PATH_CHAR* file_path);
+	void Close();
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return dataSize; }
+
+	// The offset of the first event with the time >= time_key (GetSize() - none)
+	size_t FindTime(uint64_t time_key) const;
+	// Calls proc for the events of [from_key, to_key] time range with the level in level_mask (see LogLvlMask).
+	// Returns the number of events passed to proc.
+	long long Query(uint64_t from_key, uint64_t to_key, unsigned level_mask, EventProc proc) const;
+
+	// Side index: built from the mapped file (reads only the pages at the index steps), the saved index
+	// is used while the file is only appended
+	size_t BuildIndex(size_t step = LogIndexStepDefault);
+	bool SaveIndex(const FILE_PATH_CHAR* index_path) const;
+	bool LoadIndex(const FILE_PATH_CHAR* index_path);
+	size_t GetIndexSize() const { return index.size(); }
+};
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_FILE_READER_H_
@@ -0,0 +1,211 @@
+// ****** Memory-mapped ring buffer log target. (c) 2025 LISV ******
+#include "LogMemRing.h"
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LisLog {
+
+const char LogMemRingSignature[8] = { 'L', 'I', 'S', 'R', 'I', 'N', 'G', '1' };
+const uint32_t LogMemRingHeaderSpace = 64; // the data area offset
+
+static inline uint64_t LogMemRing_Align(uint64_t size)
+{
+	return (size + LogMemRingAlign - 1) & ~(uint64_t)(LogMemRingAlign - 1);
+}
+
+// Checks that the header describes the consistent ring of the file size
+static bool LogMemRing_IsValid(const LogMemRingHeader* header, uint64_t file_size)
+{
+	return 0 == std::memcmp(header->Signature, LogMemRingSignature, sizeof(header->Signature))
+		&& LogMemRingHeaderSpace == header->HeaderSize && LogMemRingAlign == header->RecordAlign
+		&& LogMemRingHeaderSpace + header->DataSize == file_size
+		&& header->Tail <= header->Head && header->Head - header->Tail <= header->DataSize
+		&& 0 == header->Tail % LogMemRingAlign && 0 == header->Head % LogMemRingAlign;
+}
+
+// Checks the record at the position (the file may be damaged, e.g. written by the other process)
+static bool LogMemRing_IsRecordValid(const LogMemRingRecord* rec, uint64_t pos, uint64_t data_size)
+{
+	return rec->Size >= sizeof(LogMemRingRecord) && 0 == rec->Size % LogMemRingAlign
+		&& pos % data_size + rec->Size <= data_size && sizeof(LogMemRingRecord) + rec->TextLen <= rec->Size;
+}
+
+// *************************************** LogTargetMemRing ****************************************
+
+LogTargetMemRing::LogTargetMemRing(const FILE_PATH_CHAR* file_path, uint64_t data_size, LogLevel lvl)
+	: LogTargetBase(lvl), fileHandle(-1), mapHandle(-1), header(nullptr), data(nullptr)
+{
+	status = -1;
+	data_size = LogMemRing_Align(data_size);
+	if (data_size >= LogMemRingAlign * 2) Open(file_path, data_size);
+}
+
+LogTargetMemRing::~LogTargetMemRing()
+{
+	Close();
+}
+
+#ifdef _WINDOWS
+
+void LogTargetMemRing::Open(const FILE_PATH_CHAR* file_path, uint64_t data_size)
+{
+	uint64_t file_size = LogMemRingHeaderSpace + data_size;
+	HANDLE file = CreateFile(file_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == file) return; // ERROR: can't open the file
+	fileHandle = (intptr_t)file;
+	LARGE_INTEGER size;
+	bool is_same_size = GetFileSizeEx(file, &size) && (uint64_t)size.QuadPart == file_size;
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READWRITE,
+		(DWORD)(file_size >> 32), (DWORD)file_size, NULL); // extends the file if needed
+	if (!mapping) return; // ERROR: mapping
+	mapHandle = (intptr_t)mapping;
+	void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)file_size);
+	if (!view) return; // ERROR: mapping
+	header = (LogMemRingHeader*)view;
+	data = (char*)view + LogMemRingHeaderSpace;
+	if (!is_same_size || !LogMemRing_IsValid(header, file_size)) {
+		std::memset(header, 0, LogMemRingHeaderSpace);
+		header->HeaderSize = LogMemRingHeaderSpace;
+		header->RecordAlign = LogMemRingAlign;
+		header->DataSize = data_size;
+		std::memcpy(header->Signature, LogMemRingSignature, sizeof(header->Signature));
+	}
+	status = 0;
+}
+
+void LogTargetMemRing::Close()
+{
+	if (header) UnmapViewOfFile(header);
+	if (mapHandle >= 0) CloseHandle((HANDLE)mapHandle);
+	if (fileHandle >= 0) CloseHandle((HANDLE)fileHandle);
+	header = nullptr;
+	data = nullptr;
+	mapHandle = fileHandle = -1;
+}
+
+#else
+
+void LogTargetMemRing::Open(const FILE_PATH_CHAR* file_path, uint64_t data_size)
+{
+	uint64_t file_size = LogMemRingHeaderSpace + data_size;
+	int file = open(file_path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (file < 0) return; // ERROR: can't open the file
+	fileHandle = file;
+	struct stat info;
+	bool is_same_size = (0 == fstat(file, &info)) && (uint64_t)info.st_size == file_size;
+	if (!is_same_size && 0 != ftruncate(file, file_size)) return; // ERROR: file size
+	void* view = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (MAP_FAILED == view) return; // ERROR: mapping
+	header = (LogMemRingHeader*)view;
+	data = (char*)view + LogMemRingHeaderSpace;
+	if (!is_same_size || !LogMemRing_IsValid(header, file_size)) {
+		std::memset(header, 0, LogMemRingHeaderSpace);
+		header->HeaderSize = LogMemRingHeaderSpace;
+		header->RecordAlign = LogMemRingAlign;
+		header->DataSize = data_size;
+		std::memcpy(header->Signature, LogMemRingSignature, sizeof(header->Signature));
+	}
+	status = 0;
+}
+
+void LogTargetMemRing::Close()
+{
+	if (header) munmap(header, LogMemRingHeaderSpace + header->DataSize);
+	if (fileHandle >= 0) close((int)fileHandle);
+	header = nullptr;
+	data = nullptr;
+	fileHandle = -1;
+}
+
+#endif
+
+void LogTargetMemRing::Append(const char* txt, size_t len)
+{
+	uint64_t data_size = header->DataSize;
+	if (sizeof(LogMemRingRecord) + len > data_size) len = data_size - sizeof(LogMemRingRecord);
+	uint64_t rec_size = LogMemRing_Align(sizeof(LogMemRingRecord) + len);
+	uint64_t head = header->Head, tail = header->Tail;
+	uint64_t pad_size = (head % data_size + rec_size > data_size) ? data_size - head % data_size : 0;
+
+	// Free the space: drop the oldest records; the header is consistent (Tail <= Head) at any moment
+	while (tail < head && head + pad_size + rec_size - tail > data_size) {
+		const LogMemRingRecord* rec = (const LogMemRingRecord*)(data + tail % data_size);
+		if (!LogMemRing_IsRecordValid(rec, tail, data_size) || tail + rec->Size > head) {
+			tail = head; // ERROR: data, the ring is reset
+			break;
+		}
+		tail += rec->Size;
+	}
+	header->Tail = tail;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (pad_size > 0) {
+		LogMemRingRecord* pad = (LogMemRingRecord*)(data + head % data_size);
+		pad->Size = (uint32_t)pad_size;
+		pad->TextLen = 0;
+		pad->Sequence = 0;
+		head += pad_size;
+		if (head + rec_size - tail > data_size) { // the record overlaps the padding, the ring is empty
+			std::atomic_thread_fence(std::memory_order_release);
+			header->Head = head;
+			std::atomic_thread_fence(std::memory_order_release);
+			header->Tail = tail = head;
+		}
+	}
+	LogMemRingRecord* rec = (LogMemRingRecord*)(data + head % data_size);
+	rec->Size = (uint32_t)rec_size;
+	rec->TextLen = (uint32_t)len;
+	rec->Sequence = header->Sequence;
+	std::memcpy(rec + 1, txt, len);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->Sequence = rec->Sequence + 1;
+	header->Head = head + rec_size; // the record is committed
+}
+
+void LogTargetMemRing::WriteEvent(const LogEvent& evt)
+{
+	if (0 != status) return;
+	std::lock_guard<std::mutex> sync_lock(ringSync);
+	WriteEventAsText(evt, [this](EventType type, const char* txt) { Append(txt, std::strlen(txt)); }, false);
+}
+
+// **************************************** LogMemRingRead *****************************************
+
+long long LogMemRingRead(const FILE_PATH_CHAR* file_path, LogMemRingReadProc proc)
+{
+	std::ifstream file_stm(file_path, std::ios_base::in | std::ios::binary);
+	LogMemRingHeader header;
+	if (!file_stm.read((char*)&header, sizeof(header))) return -1; // ERROR: read
+	file_stm.seekg(0, std::ios_base::end);
+	uint64_t file_size = file_stm.tellg();
+	if (!LogMemRing_IsValid(&header, file_size)) return -2; // ERROR: data
+	std::vector<char> data((size_t)header.DataSize);
+	file_stm.seekg(LogMemRingHeaderSpace);
+	if (!file_stm.read(data.data(), data.size())) return -1; // ERROR: read
+
+	long long result = 0;
+	uint64_t pos = header.Tail;
+	while (pos < header.Head) {
+		const LogMemRingRecord* rec = (const LogMemRingRecord*)(data.data() + pos % header.DataSize);
+		if (!LogMemRing_IsRecordValid(rec, pos, header.DataSize)) return -2; // ERROR: data
+		if (rec->TextLen > 0) {
+			++result;
+			if (!proc(rec->Sequence, (const char*)(rec + 1), rec->TextLen)) break;
+		}
+		pos += rec->Size;
+	}
+	return result;
+}
+
+} // namespace LisLog
@@ -0,0 +1,64 @@
+// ****** Memory-mapped ring buffer log target. (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_MEM_RING_H_
+#define _LIS_LOG_MEM_RING_H_
+
+#include "Logger.h"
+
+namespace LisLog {
+
+// The file keeps the last events (formatted text), it is written through the memory mapping,
+// so the events are in the file (OS page cache) even if the process crashes.
+// File layout: LogMemRingHeader, then the data area used as a circular buffer of records.
+// Positions (Head, Tail) are logical byte offsets, the physical offset is position % DataSize.
+// Record: LogMemRingRecord + text (not null-terminated), the size is aligned to LogMemRingAlign;
+// a record never wraps around, the space at the end is filled by the padding record if needed.
+
+struct LogMemRingHeader
+{
+	char Signature[8];
+	uint32_t HeaderSize;
+	uint32_t RecordAlign;
+	uint64_t DataSize;
+	volatile uint64_t Tail; // position of the oldest record
+	volatile uint64_t Head; // position after the newest record (updated after the record is written)
+	volatile uint64_t Sequence; // number of the next record
+};
+
+struct LogMemRingRecord
+{
+	uint32_t Size; // full size of the record (aligned)
+	uint32_t TextLen; // 0 for the padding record
+	uint64_t Sequence;
+};
+
+extern const char LogMemRingSignature[8];
+const uint32_t LogMemRingAlign = 16;
+
+class LogTargetMemRing : public LogTargetBase
+{
+	std::mutex ringSync;
+	intptr_t fileHandle, mapHandle;
+	LogMemRingHeader* header;
+	char* data;
+
+	void Open(const FILE_PATH_CHAR* file_path, uint64_t data_size);
+	void Close();
+	void Append(const char* txt, size_t len);
+protected:
+	virtual void WriteEvent(const LogEvent& evt) override;
+public:
+	// data_size - size of the data area (rounded up to LogMemRingAlign);
+	// the events from the existing file of the same size are preserved
+	LogTargetMemRing(const FILE_PATH_CHAR* file_path, uint64_t data_size, LogLevel lvl = llDebug);
+	virtual ~LogTargetMemRing();
+};
+
+// Reads the events from the ring file in order (the oldest first), proc returns false to stop.
+// Returns count of the events read or negative value on error.
+typedef std::function<bool(uint64_t sequence, const char* txt, size_t len)> LogMemRingReadProc;
+long long LogMemRingRead(const FILE_PATH_CHAR* file_path, LogMemRingReadProc proc);
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_MEM_RING_H_
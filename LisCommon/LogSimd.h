@@ -0,0 +1,32 @@
+// ****** Logger internal SIMD helpers. (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_SIMD_H_
+#define _LIS_LOG_SIMD_H_
+
+// Included by the logger sources only (not a part of the public headers)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIS_LOG_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace LisLog {
+
+// Index of the lowest set bit (of the SSE2 compare mask), the mask must not be 0
+static inline unsigned LogLowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return idx;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_SIMD_H_
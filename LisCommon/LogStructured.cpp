@@ -0,0 +1,213 @@
+// ****** Structured (key/value) logging, JSON lines target. (c) 2025 LISV ******
+#include "LogStructured.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "LogSimd.h"
+
+namespace LisLog {
+
+extern const char* LogLvlStr[LogLevel::llNone];
+
+const size_t LogJsonNumberMaxLen = 32;
+
+// ****************************************** Formatting *******************************************
+
+static const char LogDigitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Decimal digits two at a time (instead of snprintf)
+static char* LogPutUInt(char* dst, unsigned long long value)
+{
+	char tmp[20];
+	char* pos = tmp + sizeof(tmp);
+	while (value >= 100) {
+		const char* pair = LogDigitPairs + (value % 100) * 2;
+		value /= 100;
+		pos -= 2;
+		pos[0] = pair[0];  pos[1] = pair[1];
+	}
+	if (value >= 10) {
+		pos -= 2;
+		pos[0] = LogDigitPairs[value * 2];  pos[1] = LogDigitPairs[value * 2 + 1];
+	} else *--pos = (char)('0' + value);
+	size_t len = tmp + sizeof(tmp) - pos;
+	std::memcpy(dst, pos, len);
+	return dst + len;
+}
+
+static char* LogPutInt(char* dst, long long value)
+{
+	if (value >= 0) return LogPutUInt(dst, (unsigned long long)value);
+	*dst++ = '-';
+	return LogPutUInt(dst, 0 - (unsigned long long)value);
+}
+
+// 15 significant digits (like "%.15g"), the usual magnitudes are formatted without snprintf;
+// not finite values are written as null
+static char* LogPutDouble(char* dst, double value)
+{
+	static const unsigned long long pow10[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+		10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+		10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL };
+	const int SignificantDigits = 15;
+
+	if (!std::isfinite(value)) {
+		std::memcpy(dst, "null", 4);
+		return dst + 4;
+	}
+	double abs_value = std::fabs(value);
+	if (0 == value) {
+		*dst = '0';
+		return dst + 1;
+	}
+	if (abs_value < 1e-3 || abs_value >= 1e15)
+		return dst + std::snprintf(dst, LogJsonNumberMaxLen, "%.15g", value);
+
+	unsigned long long int_part = (unsigned long long)abs_value;
+	int int_digits = 0;
+	while (int_digits < SignificantDigits && int_part >= pow10[int_digits]) ++int_digits;
+	int frac_digits = SignificantDigits - int_digits;
+	if (0 == int_part) { // the leading zeros of the fraction aren't significant
+		for (double v = abs_value * 10; v < 1; v *= 10) ++frac_digits;
+	}
+	unsigned long long frac_part = (unsigned long long)std::llround((abs_value - int_part) * pow10[frac_digits]);
+	if (frac_part >= pow10[frac_digits]) { // rounded up to the next integer
+		++int_part;
+		frac_part -= pow10[frac_digits];
+	}
+	if (value < 0) *dst++ = '-';
+	dst = LogPutUInt(dst, int_part);
+	if (0 == frac_part) return dst;
+	while (0 == frac_part % 10) { // trailing zeros
+		frac_part /= 10;
+		--frac_digits;
+	}
+	*dst++ = '.';
+	for (int i = frac_digits - 1; i >= 0; --i) {
+		dst[i] = (char)('0' + frac_part % 10);
+		frac_part /= 10;
+	}
+	return dst + frac_digits;
+}
+
+char* LogJsonEscape(char* dst, const char* src, size_t src_len)
+{
+	static const char* hex_digits = "0123456789abcdef";
+	const char* src_end = src + src_len;
+	while (src < src_end) {
+#ifdef LIS_LOG_SSE2
+		// The chars without escaping are copied by 16 bytes
+		if (src_end - src >= 16) {
+			const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), ctrl_max = _mm_set1_epi8(0x1F);
+			__m128i chunk = _mm_loadu_si128((const __m128i*)src);
+			__m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+				_mm_cmpeq_epi8(_mm_max_epu8(chunk, ctrl_max), ctrl_max)); // unsigned chunk <= 0x1F
+			unsigned mask = (unsigned)_mm_movemask_epi8(special);
+			_mm_storeu_si128((__m128i*)dst, chunk);
+			unsigned count = mask ? LogLowestBit(mask) : 16;
+			src += count;
+			dst += count;
+			if (!mask) continue;
+		}
+#endif
+		unsigned char chr = (unsigned char)*src++;
+		if ('"' == chr || '\\' == chr) {
+			dst[0] = '\\';  dst[1] = (char)chr;
+			dst += 2;
+		} else if (chr < 0x20) {
+			dst[0] = '\\';
+			switch (chr) {
+			case '\n': dst[1] = 'n'; dst += 2; break;
+			case '\r': dst[1] = 'r'; dst += 2; break;
+			case '\t': dst[1] = 't'; dst += 2; break;
+			case '\b': dst[1] = 'b'; dst += 2; break;
+			case '\f': dst[1] = 'f'; dst += 2; break;
+			default:
+				std::memcpy(dst + 1, "u00", 3);
+				dst[4] = hex_digits[chr >> 4];  dst[5] = hex_digits[chr & 0xF];
+				dst += 6;
+			}
+		} else *dst++ = (char)chr;
+	}
+	return dst;
+}
+
+size_t LogFieldsToJson(char* buf, size_t len, LogFields fields)
+{
+	char* pos = buf;
+	char* end = buf + len - 1; // place for '\0'
+	for (const LogField& field : fields) {
+		size_t key_len = std::strlen(field.Key);
+		size_t value_max = (LogField::lftStr == field.Type) ? field.Str.Len * 6 + 2 : LogJsonNumberMaxLen;
+		if ((size_t)(end - pos) < 1 + key_len * 6 + 3 + value_max) continue; // ERROR: doesn't fit
+		if (pos != buf) *pos++ = ',';
+		*pos++ = '"';
+		pos = LogJsonEscape(pos, field.Key, key_len);
+		*pos++ = '"';
+		*pos++ = ':';
+		switch (field.Type) {
+		case LogField::lftInt: pos = LogPutInt(pos, field.Int); break;
+		case LogField::lftUInt: pos = LogPutUInt(pos, field.UInt); break;
+		case LogField::lftDouble: pos = LogPutDouble(pos, field.Dbl); break;
+		case LogField::lftBool:
+			std::memcpy(pos, field.Bool ? "true" : "false", field.Bool ? 4 : 5);
+			pos += field.Bool ? 4 : 5;
+			break;
+		default: // lftStr
+			*pos++ = '"';
+			pos = LogJsonEscape(pos, field.Str.Ptr, field.Str.Len);
+			*pos++ = '"';
+		}
+	}
+	*pos = 0;
+	return pos - buf;
+}
+
+// *************************************** LogTargetJsonFile ***************************************
+
+void LogTargetJsonFile::WriteEventAsJson(const LogEvent& evt, TextWriteFunc func)
+{
+	static thread_local std::string json_buf;
+
+	char time_buf[0x40];
+	int time_len = GetTimeStr(evt.Time, time_buf, sizeof(time_buf));
+	if (time_len < 0) time_len = 0;
+	size_t data_len = std::strlen(evt.Data);
+	size_t fields_len = (evt.Fields && etGeneral == evt.Type) ? std::strlen(evt.Fields) : 0;
+	json_buf.resize(0x40 + time_len + data_len * 6 + fields_len); // the longest possible text
+	char* pos = &json_buf[0];
+	std::memcpy(pos, "{\"time\":\"", 9);
+	pos += 9;
+	std::memcpy(pos, time_buf, time_len);
+	pos += time_len;
+	std::memcpy(pos, "\",\"level\":\"", 11);
+	pos += 11;
+	const char* lvl = (evt.Level >= 0 && evt.Level < llNone) ? LogLvlStr[evt.Level] : "";
+	size_t lvl_len = std::strlen(lvl);
+	std::memcpy(pos, lvl, lvl_len);
+	pos += lvl_len;
+	std::memcpy(pos, "\",\"msg\":\"", 9);
+	pos += 9;
+	pos = LogJsonEscape(pos, evt.Data, data_len);
+	*pos++ = '"';
+	if (etSubsequent == evt.Type) {
+		std::memcpy(pos, ",\"subsequent\":true", 18);
+		pos += 18;
+	} else if (fields_len > 0) {
+		*pos++ = ',';
+		std::memcpy(pos, evt.Fields, fields_len);
+		pos += fields_len;
+	}
+	pos[0] = '}';  pos[1] = '\n';  pos[2] = 0;
+	func(evt.Type, json_buf.c_str());
+}
+
+void LogTargetJsonFile::FormatEvent(const LogEvent& evt, TextWriteFunc func)
+{
+	WriteEventAsJson(evt, func);
+}
+
+} // namespace LisLog
@@ -0,0 +1,37 @@
+// ****** Structured (key/value) logging, JSON lines target. (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_LOG_STRUCTURED_H_
+#define _LIS_LOG_STRUCTURED_H_
+
+#include "Logger.h"
+
+namespace LisLog {
+
+// Serializes the fields as JSON object members ("key":value,...) to buf (null-terminated),
+// the fields which don't fit are skipped. Returns the text length.
+size_t LogFieldsToJson(char* buf, size_t len, LogFields fields);
+
+// JSON string escaping, dst must have place for src_len * 6 chars; returns the end of the written text
+char* LogJsonEscape(char* dst, const char* src, size_t src_len);
+
+// *************************************** LogTargetJsonFile ***************************************
+
+// Writes the events as JSON lines to the text log files (same files management as LogTargetTextFile):
+// {"time":"<time>","level":"<lvl>","msg":"<text>",<fields>}
+// subsequent events (e.g. hex dump) get "subsequent":true instead of the fields
+class LogTargetJsonFile : public LogTargetTextFile
+{
+protected:
+	virtual void FormatEvent(const LogEvent& evt, TextWriteFunc func) override;
+public:
+	LogTargetJsonFile(const FILE_PATH_CHAR* location_path,
+		const FILE_PATH_CHAR* file_name_prefix, LogLevel lvl = llInfo,
+		LogFlushPolicy flush_policy = lfpEvent, unsigned flush_value = 0)
+		: LogTargetTextFile(location_path, file_name_prefix, lvl, flush_policy, flush_value) { }
+
+	static void WriteEventAsJson(const LogEvent& evt, TextWriteFunc func);
+};
+
+} // namespace LisLog
+
+#endif // #ifndef _LIS_LOG_STRUCTURED_H_
@@ -4,12 +4,19 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
-#include <fstream>
 #include <iomanip>
+#include "LogEventQueue.h"
+#include "LogStructured.h"
 #include "StrUtils.h"
 
 #ifdef _WINDOWS
 #include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #endif
 
 namespace LisLog {
@@ -24,56 +31,294 @@ const auto EvtTimeNone = std::chrono::system_clock::time_point(std::chrono::syst
 const char* LogLvlStr[LogLevel::llNone] = { "trc", "dbg", "inf", "Wrn", "ERR", "FLT" };
 const int LogLvlTxtMaxLen = 3;
 
-const LoggerSettings default_logger_settings = { };
+const int AsyncIdleWaitMs = 100;
+const size_t AsyncBatchMax = 0x40; // events delivered to the targets at once
 
-static ILogger* logger_singleton = nullptr; // Global singleton
+const int TimeZoneCheckSec = 60; // how often the time zone (and DST) info is reloaded
 
-int Logger::InitSingleton(LoggerSettings settings, LogTargetBase* targets[], size_t target_count)
+static void LogLocalTime(std::time_t time, std::tm* result)
+{
+#ifdef _WINDOWS
+	localtime_s(result, &time);
+#else
+	localtime_r(&time, result);
+#endif
+}
+
+static void LogTimeZoneUpdate()
+{
+#ifdef _WINDOWS
+	_tzset();
+#else
+	tzset();
+#endif
+}
+
+static inline void LogPutDigits(char* dst, unsigned value, int count)
 {
-	if (logger_singleton) {
-		delete logger_singleton;
-		logger_singleton = nullptr;
+	while (count-- > 0) {
+		dst[count] = '0' + value % 10;
+		value /= 10;
 	}
-	logger_singleton = new Logger(settings);
-	for (size_t i = 0; i < target_count; ++i) logger_singleton->AddTarget(targets[i]);
-	return 0;
 }
 
-ILogger* Logger::GetInstance()
+// Hex dump lines: "<offset>: " (at least 4 hex digits), 16 x "xx ", the bytes as ASCII ('.' if not printable)
+const unsigned LogHexLineWidth = 0x10;
+const unsigned LogHexLineMaxLen = 16 + 2 + LogHexLineWidth * 4 + 1; // 16 - offset digits, 1 - '\n'
+
+static size_t LogHexDumpSize(size_t size)
 {
-	if (!logger_singleton)
-		InitSingleton(default_logger_settings, nullptr, 0); // is it necessary?
-	return logger_singleton;
+	return (size + LogHexLineWidth - 1) / LogHexLineWidth * LogHexLineMaxLen + 1;
 }
 
-Logger::Logger(LoggerSettings settings)
+// Renders the dump to dst (LogHexDumpSize(size) bytes), returns the text length
+static size_t LogHexDump(char* dst, const unsigned char* data, size_t size)
+{
+	static const struct HexTables {
+		char Hex[0x100][3]; // "xx "
+		char Chr[0x100];
+		HexTables() {
+			const char* digits = "0123456789abcdef";
+			for (int i = 0; i < 0x100; ++i) {
+				Hex[i][0] = digits[i >> 4];
+				Hex[i][1] = digits[i & 0xF];
+				Hex[i][2] = ' ';
+				Chr[i] = (i >= 0x20 && i < 0x80) ? (char)i : '.';
+			}
+		}
+	} tables;
+
+	char* pos = dst;
+	int offset_digits = 4;
+	for (size_t i = 0; i < size; i += LogHexLineWidth) {
+		if (i != 0) *pos++ = '\n';
+		while ((offset_digits < 16) && (i >> (offset_digits * 4))) ++offset_digits;
+		for (int d = offset_digits - 1; d >= 0; --d) pos[offset_digits - 1 - d] = tables.Hex[(i >> (d * 4)) & 0xF][1];
+		pos += offset_digits;
+		pos[0] = ':';  pos[1] = ' ';
+		pos += 2;
+
+		size_t count = std::min<size_t>(LogHexLineWidth, size - i);
+		const unsigned char* line = data + i;
+		for (size_t c = 0; c < count; ++c) {
+			std::memcpy(pos, tables.Hex[line[c]], 3);
+			pos += 3;
+		}
+		std::memset(pos, ' ', (LogHexLineWidth - count) * 3);
+		pos += (LogHexLineWidth - count) * 3;
+		for (size_t c = 0; c < count; ++c) *pos++ = tables.Chr[line[c]];
+	}
+	*pos = 0;
+	return pos - dst;
+}
+
+ILogger* Logger::singleton = nullptr; // Global singleton
+
+int Logger::InitSingleton(LoggerSettings settings, LogTargetBase* targets[], size_t target_count)
+{
+	if (singleton) {
+		delete singleton;
+		singleton = nullptr;
+	}
+	singleton = new Logger(settings);
+	for (size_t i = 0; i < target_count; ++i) singleton->AddTarget(targets[i]);
+	return 0;
+}
+
+static std::atomic<uint64_t> Logger_InstanceCount(0);
+
+Logger::Logger(LoggerSettings settings) : clock(settings.Clock), asyncThread(nullptr), asyncStopFlag(false), flushRequest(0), flushDone(0),
+	rootLevel(llTrace), limitsOn(false), cntSampled(0), cntRepeated(0), instanceId(++Logger_InstanceCount)
 {
-	this->lowestLogLevel = llNone;
 	this->settings = settings;
-	this->lastEventTime = EvtTimeNone;
+	for (int lvl = 0; lvl < llNone; ++lvl) {
+		levelLimiters[lvl].Setup(settings.LevelRateLimit[lvl].Rate, settings.LevelRateLimit[lvl].Burst);
+		if (settings.LevelRateLimit[lvl].Rate || settings.LevelSampleRate[lvl] > 1) limitsOn = true;
+	}
+	if (settings.AsyncMode) {
+		asyncQueue.reset(new LogEventQueue(settings.AsyncQueueSize, settings.AsyncOverflow));
+		asyncThread = new std::thread(AsyncMainProc, this);
+	}
 }
 
-Logger::~Logger() { }
+Logger::~Logger()
+{
+	FlushRepeats();
+	if (asyncThread) {
+		asyncStopFlag = true;
+		asyncQueue->Wake();
+		asyncThread->join(); // the queue is drained before the thread finishes
+		delete asyncThread;
+	}
+}
 
 bool Logger::LogLvlChk(LogLevel event_level, LogLevel target_level)
 {
 	return (event_level >= 0) && (event_level < LogLevel::llNone) && (event_level >= target_level);
 }
 
-void Logger::WriteEvent(LogTargetBase::EventType typ, LogLevel lvl, const char* txt)
+bool Logger::LogLimitChk(LogLevel lvl)
+{
+	static thread_local unsigned sample_counters[llNone] = {};
+
+	unsigned sample_rate = settings.LevelSampleRate[lvl];
+	if ((sample_rate > 1) && (0 != sample_counters[lvl]++ % sample_rate)) {
+		cntSampled.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return levelLimiters[lvl].Allow();
+}
+
+void Logger::WriteGeneral(LogLevel lvl, const char* txt, bool coalesce, const char* fields)
+{
+	if (settings.SuppressRepeats) {
+		// The last message of the thread, coalesce - the message may be counted as a repeat
+		RepeatState& last_msg = GetRepeatState();
+		std::lock_guard<std::mutex> sync_lock(last_msg.Sync);
+		size_t len = std::strlen(txt);
+		bool is_repeat = coalesce && (lvl == last_msg.Level) && (len == last_msg.Text.size())
+			&& (0 == std::memcmp(txt, last_msg.Text.data(), len));
+		if (is_repeat) {
+			cntRepeated.fetch_add(1, std::memory_order_relaxed);
+			int64_t now = LogRateLimiter::Now();
+			if (0 == last_msg.Count++) last_msg.Since = now;
+			if (now - last_msg.Since < (int64_t)settings.RepeatReportMs * 1000000) return;
+		}
+		if (last_msg.Count > 0) {
+			WriteRepeatSummary(last_msg);
+			if (is_repeat) return; // the report period elapsed, the repeat itself isn't written
+		}
+		if (coalesce) {
+			last_msg.Level = lvl;
+			last_msg.Text.assign(txt, len);
+		} else last_msg.Level = llNone;
+		WriteEvent(LogTargetBase::EventType::etGeneral, lvl, txt, fields);
+		return;
+	}
+	WriteEvent(LogTargetBase::EventType::etGeneral, lvl, txt, fields);
+}
+
+Logger::RepeatState& Logger::GetRepeatState()
+{
+	// The state of the last used logger; owned by the logger and the thread,
+	// the logger releases the state no thread refers to
+	static thread_local struct { uint64_t LoggerId; std::shared_ptr<RepeatState> State; } thread_state = { 0, nullptr };
+
+	if (instanceId != thread_state.LoggerId) {
+		std::lock_guard<std::mutex> sync_lock(repeatsSync);
+		thread_state.LoggerId = instanceId;
+		thread_state.State = std::make_shared<RepeatState>();
+		repeatStates.push_back(thread_state.State);
+	}
+	return *thread_state.State;
+}
+
+void Logger::WriteRepeatSummary(RepeatState& state)
+{
+	char summary[48];
+	std::snprintf(summary, sizeof(summary), "Last message repeated %u times", state.Count);
+	WriteEvent(LogTargetBase::EventType::etGeneral, state.Level, summary);
+	state.Count = 0;
+}
+
+void Logger::FlushRepeats()
 {
-	bool is_gen = LogTargetBase::EventType::etGeneral == typ;
+	if (!settings.SuppressRepeats) return;
+	std::lock_guard<std::mutex> sync_lock(repeatsSync);
+	for (auto it = repeatStates.begin(); it != repeatStates.end(); ) {
+		{
+			std::lock_guard<std::mutex> state_lock((*it)->Sync);
+			if ((*it)->Count > 0) WriteRepeatSummary(**it);
+		}
+		if (1 == it->use_count()) it = repeatStates.erase(it); // the thread finished or uses another logger
+		else ++it;
+	}
+}
+
+void Logger::WriteEvent(LogTargetBase::EventType typ, LogLevel lvl, const char* txt, const char* fields)
+{
+	// Stamp of the last general event, subsequent events get it (per thread and logger);
+	// the time is not decreasing per thread (the clocks may be adjusted back)
+	static thread_local struct { const Logger* Owner; uint64_t Stamp; std::chrono::system_clock::time_point Time; }
+		last_event = { nullptr, 0, EvtTimeNone };
+
+	if (LogTargetBase::EventType::etGeneral == typ || this != last_event.Owner) {
+		if (this != last_event.Owner) last_event.Time = EvtTimeNone;
+		last_event.Owner = this;
+		last_event.Stamp = clock.Stamp();
+	}
+	if (asyncQueue && !IsAsyncThread()) { // the events of the targets are written at once (the queue may be full)
+		asyncQueue->Push(typ, lvl, last_event.Stamp, txt, fields); // the time is calculated by the async thread
+		return;
+	}
 	LogTargetBase::LogEvent evt;
 	evt.Type = typ;
 	evt.Level = lvl;
-	evt.Time = is_gen ? std::chrono::system_clock::now() : lastEventTime;
+	evt.Time = std::max(clock.ToTime(last_event.Stamp), last_event.Time);
+	last_event.Time = evt.Time;
 	evt.Data = txt;
-	if (is_gen) lastEventTime = evt.Time;
-	for (auto& target : targets) {
+	evt.Fields = fields;
+	DispatchEvent(evt);
+}
+
+void Logger::DispatchEvent(const LogTargetBase::LogEvent& evt)
+{
+	TargetSnapshot::ReadGuard targets_rd(targets);
+	for (auto target : *targets_rd) {
 		if (LogLvlChk(evt.Level, target->logLevel)) target->WriteEvent(evt);
 	}
 }
 
+void Logger::DispatchEvents(const LogTargetBase::LogEvent* events, size_t count)
+{
+	TargetSnapshot::ReadGuard targets_rd(targets);
+	for (auto target : *targets_rd) target->WriteEvents(events, count);
+}
+
+void Logger::AsyncMainProc(Logger* logger)
+{
+	LogEventQueue& queue = *logger->asyncQueue;
+	std::vector<LogEventQueue::Item> items(AsyncBatchMax);
+	LogTargetBase::LogEvent events[AsyncBatchMax];
+	auto last_time = EvtTimeNone; // the queue order is kept (the time is not decreasing)
+	for (;;) {
+		bool is_stop = logger->asyncStopFlag.load();
+		unsigned flush_req = logger->flushRequest.load();
+		bool is_flush = flush_req != logger->flushDone.load();
+		size_t flush_pos = queue.GetClaimedPos(); // read after the request: covers the events logged before it
+		for (;;) { // deliver the queued events in batches
+			size_t count = 0;
+			while (count < AsyncBatchMax && queue.Pop(items[count])) {
+				LogEventQueue::Item& item = items[count];
+				if (!item.Data) continue;
+				events[count].Type = item.Type;
+				events[count].Level = item.Level;
+				events[count].Time = last_time = std::max(logger->clock.ToTime(item.Stamp), last_time);
+				events[count].Data = item.Data;
+				events[count].Fields = item.Fields;
+				++count;
+			}
+			queue.SpaceFreed(); // the skipped items (no memory) free the place as well
+			if (0 == count) {
+				if (!(is_flush || is_stop) || queue.IsConsumed(flush_pos)) break;
+				std::this_thread::yield(); // the claimed event is being published by the producer
+				continue;
+			}
+			logger->DispatchEvents(events, count);
+			for (size_t i = 0; i < count; ++i) items[i].Reset();
+		}
+		if (is_flush) {
+			TargetSnapshot::ReadGuard targets_rd(logger->targets);
+			for (auto target : *targets_rd) target->Flush();
+			std::lock_guard<std::mutex> sync_lock(logger->flushSync);
+			logger->flushDone.store(flush_req);
+			logger->flushWake.notify_all();
+		}
+		if (is_stop) break;
+		queue.WaitItems(AsyncIdleWaitMs);
+	}
+}
+
 // *************************************** ILogger interface ***************************************
 
 LogLevel Logger::GetCurrentLogLevel()
@@ -81,126 +326,321 @@ LogLevel Logger::GetCurrentLogLevel()
 	return lowestLogLevel;
 }
 
+void Logger::SetLevel(LogLevel lvl)
+{
+	std::lock_guard<std::mutex> sync_lock(levelsSync);
+	rootLevel = lvl;
+	UpdateLevels();
+}
+
+ILogger* Logger::GetModule(const char* name)
+{
+	if (!name || !*name) return this;
+	std::lock_guard<std::mutex> sync_lock(levelsSync);
+	auto& module = modules[name];
+	if (!module) {
+		module.reset(new LoggerModule(*this, name));
+		UpdateLevels();
+	}
+	return module.get();
+}
+
+void Logger::SetModuleLevel(const std::string& name, LogLevel lvl)
+{
+	std::lock_guard<std::mutex> sync_lock(levelsSync);
+	moduleLevels[name] = lvl;
+	UpdateLevels();
+}
+
+LogLevel Logger::GetConfiguredLevel(const std::string& name) const
+{
+	std::string path = name;
+	for (;;) {
+		auto item = moduleLevels.find(path);
+		if (item != moduleLevels.end()) return item->second;
+		auto pos = path.find_last_of('.');
+		if (std::string::npos == pos) return rootLevel;
+		path.resize(pos);
+	}
+}
+
+void Logger::UpdateLevels()
+{
+	// The events below the targets level aren't written anyway
+	LogLevel targets_lvl = llNone;
+	{
+		TargetSnapshot::ReadGuard targets_rd(targets);
+		for (const auto target : *targets_rd) {
+			if (target->logLevel < targets_lvl) targets_lvl = target->logLevel;
+		}
+	}
+	lowestLogLevel = std::max(rootLevel, targets_lvl);
+	for (const auto& module : modules)
+		module.second->lowestLogLevel = std::max(GetConfiguredLevel(module.first), targets_lvl);
+}
+
 ILogger::TargetHandle Logger::AddTarget(LogTargetBase* target)
 {
 	if (!target) return nullptr;
-	targets.emplace_back(target);
-	if (target->logLevel < lowestLogLevel) lowestLogLevel = target->logLevel;
+	targets.Update([this, target](TargetList& list) {
+		targetsOwned.emplace_back(target);
+		list.push_back(target);
+		return true;
+	});
+	std::lock_guard<std::mutex> sync_lock(levelsSync);
+	UpdateLevels();
 	return target;
 }
 
 const LogTargetBase* Logger::GetTarget(int index) const
 {
-	if ((index >= 0) && (index < targets.size())) {
-		return targets[index].get();
+	TargetSnapshot::ReadGuard targets_rd(targets);
+	if ((index >= 0) && ((size_t)index < targets_rd->size())) {
+		return (*targets_rd)[index];
 	}
 	return nullptr;
 }
 
 bool Logger::DelTarget(TargetHandle target)
 {
-	auto item = std::find_if(targets.begin(), targets.end(),
-		[&target](const std::unique_ptr<LogTargetBase>& item) { return item.get() == target; });
-	if (item != targets.end()) {
-		targets.erase(item);
-		LogLevel lvl = llNone;
-		for (const auto& target : targets) {
-			if (target->logLevel < lvl) lvl = target->logLevel;
-		}
-		lowestLogLevel = lvl;
+	std::unique_ptr<LogTargetBase> deleted; // destroyed when the readers don't use it anymore
+	targets.Update([this, target, &deleted](TargetList& list) {
+		auto item = std::find_if(targetsOwned.begin(), targetsOwned.end(),
+			[&target](const std::unique_ptr<LogTargetBase>& item) { return item.get() == target; });
+		if (item == targetsOwned.end()) return false;
+		deleted = std::move(*item);
+		targetsOwned.erase(item);
+		list.erase(std::find(list.begin(), list.end(), target));
 		return true;
-	}
-	return false;
+	});
+	if (!deleted) return false;
+	std::lock_guard<std::mutex> sync_lock(levelsSync);
+	UpdateLevels();
+	return true;
 }
 
 void Logger::LogTxt(LogLevel lvl, const char* text)
 {
-	if (!LogLvlChk(lvl, lowestLogLevel)) return;
-	WriteEvent(LogTargetBase::EventType::etGeneral, lvl, text);
+	LogTxtChk(lowestLogLevel, lvl, text);
 }
 
 int Logger::LogFmt(LogLevel lvl, const char* format, ...)
 {
-	static thread_local char txt_buf[LogMsgTxtMaxLen];
-
-	if (!LogLvlChk(lvl, lowestLogLevel)) return 0;
-	int result;
 	std::va_list args;
 	va_start(args, format);
-	result = std::vsnprintf(txt_buf, sizeof(txt_buf), format, args);
+	int result = LogFmtChk(lowestLogLevel, lvl, format, args);
 	va_end(args);
-	WriteEvent(LogTargetBase::EventType::etGeneral, lvl, txt_buf);
 	return result;
 }
 
 void Logger::LogHex(LogLevel lvl, const char* text, const unsigned char* data, size_t size)
 {
-	if (!LogLvlChk(lvl, lowestLogLevel)) return;
-	LogFmt(lvl, "%s, %10.10zd bytes", text, size); // LogTargetBase::EventType::etGeneric
-	const unsigned int width = 0x10;
-	char buffer[0xFF];
-	char* buf_pos = buffer;
-	size_t buf_len = sizeof(buffer);
-	unsigned int i, c, prn_res;
-	for (i = 0; i < size; i += width) {
-		prn_res = snprintf(buf_pos, buf_len, "%4.4x: ", i);
-		if (prn_res >= 0) { buf_len -= prn_res; buf_pos += prn_res; }
-		else break; // stop if error
-
-		// show hex to the left
-		for (c = 0; c < width; ++c) {
-			if (i + c < size) prn_res = snprintf(buf_pos, buf_len, "%02x ", data[i + c]);
-			else { for (int j = 0; j < 3; ++j) buf_pos[j] = ' '; prn_res = 3; }
-			if (prn_res >= 0) { buf_len -= prn_res; buf_pos += prn_res; }
-			else break; // stop if error
-		}
+	LogHexChk(lowestLogLevel, lvl, text, data, size);
+}
 
-		// show data on the right
-		for (c = 0; (c < width) && (i + c < size); ++c) {
-			*buf_pos = (data[i + c] >= 0x20 && data[i + c] < 0x80) ? data[i + c] : '.';
-			--buf_len;
-			if (0 >= buf_len) break;
-			++buf_pos;
-		}
+void Logger::LogStruct(LogLevel lvl, const char* text, LogFields fields)
+{
+	LogStructChk(lowestLogLevel, lvl, text, fields);
+}
 
-		*buf_pos = 0;
-		WriteEvent(LogTargetBase::EventType::etSubsequent, lvl, buffer);
-		buf_pos = buffer;
-		buf_len = sizeof(buffer);
+void Logger::LogTxtChk(LogLevel min_lvl, LogLevel lvl, const char* text)
+{
+	if (!LogLvlChk(lvl, min_lvl)) return;
+	if (limitsOn && !LogLimitChk(lvl)) return;
+	WriteGeneral(lvl, text, true);
+}
+
+int Logger::LogFmtChk(LogLevel min_lvl, LogLevel lvl, const char* format, std::va_list args)
+{
+	static thread_local char txt_buf[LogMsgTxtMaxLen];
+
+	if (!LogLvlChk(lvl, min_lvl)) return 0;
+	if (limitsOn && !LogLimitChk(lvl)) return 0;
+	int result = std::vsnprintf(txt_buf, sizeof(txt_buf), format, args);
+	WriteGeneral(lvl, txt_buf, true);
+	return result;
+}
+
+void Logger::LogHexChk(LogLevel min_lvl, LogLevel lvl, const char* text, const unsigned char* data, size_t size)
+{
+	static thread_local char header[LogMsgTxtMaxLen];
+	static thread_local std::vector<char> dump;
+
+	if (!LogLvlChk(lvl, min_lvl)) return;
+	if (limitsOn && !LogLimitChk(lvl)) return;
+	std::snprintf(header, sizeof(header), "%s, %10.10zd bytes", text, size);
+	WriteGeneral(lvl, header, false); // LogTargetBase::EventType::etGeneric
+	if (0 == size) return;
+	// The whole dump is one multi-line event (the lines are separated by '\n')
+	dump.resize(LogHexDumpSize(size));
+	LogHexDump(dump.data(), data, size);
+	WriteEvent(LogTargetBase::EventType::etSubsequent, lvl, dump.data());
+}
+
+void Logger::LogStructChk(LogLevel min_lvl, LogLevel lvl, const char* text, LogFields fields)
+{
+	static thread_local char fields_buf[LogMsgTxtMaxLen];
+
+	if (!LogLvlChk(lvl, min_lvl)) return;
+	if (limitsOn && !LogLimitChk(lvl)) return;
+	LogFieldsToJson(fields_buf, sizeof(fields_buf), fields);
+	WriteGeneral(lvl, text, false, fields_buf);
+}
+
+void Logger::Flush()
+{
+	FlushRepeats();
+	if (asyncQueue && !IsAsyncThread()) { // the async thread (a target) would wait for itself
+		unsigned flush_req = ++flushRequest;
+		asyncQueue->Wake();
+		std::unique_lock<std::mutex> sync_lock(flushSync);
+		flushWake.wait(sync_lock, [this, flush_req] { return (int)(flushDone.load() - flush_req) >= 0; });
+	} else {
+		TargetSnapshot::ReadGuard targets_rd(targets);
+		for (auto target : *targets_rd) target->Flush();
 	}
 }
 
+bool Logger::GetAsyncStats(LogQueueStats& stats) const
+{
+	if (!asyncQueue) return false;
+	asyncQueue->GetStats(stats);
+	return true;
+}
+
+void Logger::GetSuppressStats(LogSuppressStats& stats) const
+{
+	stats.RateLimited = 0;
+	for (const auto& limiter : levelLimiters) stats.RateLimited += limiter.GetSuppressed();
+	stats.Sampled = cntSampled.load(std::memory_order_relaxed);
+	stats.Repeated = cntRepeated.load(std::memory_order_relaxed);
+}
+
+// **************************************** LogSiteLimiter *****************************************
+
+std::atomic<LogSiteLimiter*> LogSiteLimiter::first(nullptr);
+
+LogSiteLimiter::LogSiteLimiter(unsigned rate, unsigned burst, const char* file_name, unsigned line_num)
+	: LogRateLimiter(rate, burst), next(first.load(std::memory_order_relaxed)), file(file_name), line(line_num)
+{
+	while (!first.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) { }
+}
+
+void LogSiteLimiter::GetStats(std::vector<LogSiteStats>& stats)
+{
+	stats.clear();
+	for (const LogSiteLimiter* site = first.load(std::memory_order_acquire); site; site = site->next)
+		stats.push_back({ site->file, site->line, site->GetSuppressed() });
+}
+
+// ***************************************** LoggerModule ******************************************
+
+int LoggerModule::LogFmt(LogLevel lvl, const char* format, ...)
+{
+	std::va_list args;
+	va_start(args, format);
+	int result = root.LogFmtChk(lowestLogLevel, lvl, format, args);
+	va_end(args);
+	return result;
+}
+
+ILogger* LoggerModule::GetModule(const char* name)
+{
+	if (!name || !*name) return this;
+	return root.GetModule((moduleName + '.' + name).c_str());
+}
+
+void LoggerModule::SetLevel(LogLevel lvl)
+{
+	root.SetModuleLevel(moduleName, lvl);
+}
+
 // ***************************************** LogTargetBase *****************************************
 
 int LogTargetBase::GetTimeStr(std::chrono::system_clock::time_point tp,
 	char* buf, size_t len, const char* tm_fmt, const char* ms_fmt)
 {
+	// Per thread cache of the default format text, rebuilt once a second
+	struct TimeStrCache {
+		std::time_t Time = -1, TimeZoneCheck = 0;
+		int Len = 0;
+		char Text[TimeTextMaxLen + 1];
+	};
+	static thread_local TimeStrCache cache;
+
 	auto time = std::chrono::system_clock::to_time_t(tp);
-	std::tm tm = *std::localtime(&time);
+	unsigned ms = (unsigned)(std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()) % 1000).count();
+	if (TimeFormat_String == tm_fmt && TimeFormat_Milliseconds == ms_fmt && len > TimeTextMaxLen) {
+		if (time != cache.Time) {
+			if (time >= cache.TimeZoneCheck || time < cache.Time) {
+				LogTimeZoneUpdate();
+				cache.TimeZoneCheck = time + TimeZoneCheckSec;
+			}
+			std::tm tm;
+			LogLocalTime(time, &tm);
+			cache.Len = std::strftime(cache.Text, sizeof(cache.Text) - 4, tm_fmt, &tm); // 4 - ".mmm"
+			cache.Text[cache.Len] = '.';
+			cache.Time = time;
+		}
+		std::memcpy(buf, cache.Text, cache.Len + 1);
+		LogPutDigits(buf + cache.Len + 1, ms, 3);
+		buf[cache.Len + 4] = 0;
+		return cache.Len + 4;
+	}
+	std::tm tm;
+	LogLocalTime(time, &tm);
 	int result = std::strftime(buf, len, tm_fmt, &tm);
-	if (ms_fmt) {
-		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()) % 1000;
+	if (ms_fmt)
 		result += std::snprintf(buf + result, len - result, ms_fmt, ms);
-	}
 	return result;
 }
 
+void LogTargetBase::WriteEvents(const LogEvent* events, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (events[i].Level >= logLevel) WriteEvent(events[i]);
+	}
+}
+
 void LogTargetBase::WriteEventAsText(const LogEvent& evt, TextWriteFunc func, bool add_newline)
 {
 	const int TxtBufLen = TimeTextMaxLen + LogLvlTxtMaxLen + 4 + LogMsgTxtMaxLen + 2; // 4 - LogLvl brackets and spaces, 2 - '\n' & '\0'
 	static thread_local char txt_buf[TxtBufLen];
 
+	if (LogTargetBase::EventType::etSubsequent == evt.Type) {
+		// Subsequent data (e.g. multi-line hex dump) isn't truncated
+		size_t data_len = std::strlen(evt.Data);
+		if (data_len + 2 > sizeof(txt_buf)) {
+			if (!add_newline) func(evt.Type, evt.Data);
+			else {
+				static thread_local std::string long_buf;
+				long_buf.assign(evt.Data, data_len);
+				long_buf += '\n';
+				func(evt.Type, long_buf.c_str());
+			}
+			return;
+		}
+	}
 	char* buf_pos = txt_buf;
 	size_t buf_len = sizeof(txt_buf) - 2; // Reserve place for '\n' & '\0'
 	if ((LogTargetBase::EventType::etGeneral == evt.Type) && (EvtTimeNone != evt.Time)) {
 		int res = GetTimeStr(evt.Time, buf_pos, buf_len);
 		buf_pos += res;  buf_len -= res;
-		res = std::snprintf(buf_pos, buf_len, " [%s] ", LogLvlStr[evt.Level]);
-		buf_pos += res;  buf_len -= res;
+		buf_pos[0] = ' ';  buf_pos[1] = '[';
+		std::memcpy(buf_pos + 2, LogLvlStr[evt.Level], LogLvlTxtMaxLen);
+		buf_pos[LogLvlTxtMaxLen + 2] = ']';  buf_pos[LogLvlTxtMaxLen + 3] = ' ';
+		buf_pos += LogLvlTxtMaxLen + 4;  buf_len -= LogLvlTxtMaxLen + 4;
 	}
 	size_t data_size = std::min<size_t>(buf_len, std::strlen(evt.Data));
 	std::memcpy(buf_pos, evt.Data, data_size);
-	buf_pos += data_size;
+	buf_pos += data_size;  buf_len -= data_size;
+	if (evt.Fields && *evt.Fields && buf_len > 3) { // " {fields}"
+		size_t fields_size = std::min<size_t>(buf_len - 3, std::strlen(evt.Fields));
+		buf_pos[0] = ' ';  buf_pos[1] = '{';
+		std::memcpy(buf_pos + 2, evt.Fields, fields_size);
+		buf_pos[fields_size + 2] = '}';
+		buf_pos += fields_size + 3;
+	}
 	if (add_newline) {
 		*buf_pos = '\n';
 		++buf_pos;
@@ -231,9 +671,117 @@ void LogTargetTextFunc::WriteEvent(const LogEvent& evt)
 
 // *************************************** LogTargetTextFile ***************************************
 
+#ifdef _WINDOWS
+
+static intptr_t LogFileOpen(const FILE_PATH_CHAR* path)
+{
+	HANDLE handle = CreateFile(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	return INVALID_HANDLE_VALUE != handle ? (intptr_t)handle : -1;
+}
+
+static bool LogFileWrite(intptr_t file, const char* data, size_t len)
+{
+	DWORD written;
+	return WriteFile((HANDLE)file, data, (DWORD)len, &written, NULL) && (written == len);
+}
+
+static bool LogFileWrite(intptr_t file, const char* data1, size_t len1, const char* data2, size_t len2)
+{
+	// WriteFileGather requires unbuffered page aligned I/O, so the parts are written one by one
+	return (0 == len1 || LogFileWrite(file, data1, len1)) && (0 == len2 || LogFileWrite(file, data2, len2));
+}
+
+static uint64_t LogFileSize(intptr_t file)
+{
+	LARGE_INTEGER size;
+	return GetFileSizeEx((HANDLE)file, &size) ? size.QuadPart : 0;
+}
+
+static bool LogFilePreallocate(intptr_t file, uint64_t size)
+{
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = size;
+	return SetFileInformationByHandle((HANDLE)file, FileAllocationInfo, &info, sizeof(info));
+}
+
+static void LogFileClose(intptr_t file, bool trim)
+{
+	// The allocation beyond the end of file is released on close
+	CloseHandle((HANDLE)file);
+}
+
+#else
+
+static intptr_t LogFileOpen(const FILE_PATH_CHAR* path)
+{
+	return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+}
+
+static bool LogFileWrite(intptr_t file, const char* data, size_t len)
+{
+	while (len > 0) {
+		ssize_t res = write((int)file, data, len);
+		if (res < 0) {
+			if (EINTR == errno) continue; // interrupted by a signal before anything was written
+			return false; // ERROR: write
+		}
+		data += res;
+		len -= res;
+	}
+	return true;
+}
+
+static bool LogFileWrite(intptr_t file, const char* data1, size_t len1, const char* data2, size_t len2)
+{
+	struct iovec parts[2] = { { (void*)data1, len1 }, { (void*)data2, len2 } };
+	struct iovec* part = parts;
+	int part_count = 2;
+	while (part_count > 0) {
+		ssize_t res = writev((int)file, part, part_count);
+		if (res < 0) {
+			if (EINTR == errno) continue;
+			return false; // ERROR: write
+		}
+		for (; part_count > 0 && (size_t)res >= part->iov_len; --part_count, ++part) res -= part->iov_len;
+		if (part_count > 0) {
+			part->iov_base = (char*)part->iov_base + res;
+			part->iov_len -= res;
+		}
+	}
+	return true;
+}
+
+static uint64_t LogFileSize(intptr_t file)
+{
+	off_t size = lseek((int)file, 0, SEEK_END);
+	return size > 0 ? size : 0;
+}
+
+static bool LogFilePreallocate(intptr_t file, uint64_t size)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+	return 0 == fallocate((int)file, FALLOC_FL_KEEP_SIZE, 0, size); // the file size is not changed
+#else
+	return false;
+#endif
+}
+
+static void LogFileClose(intptr_t file, bool trim)
+{
+	if (trim) { // release the preallocated space beyond the end of file
+		off_t size = lseek((int)file, 0, SEEK_END);
+		if (size >= 0 && 0 != ftruncate((int)file, size)) { ; }
+	}
+	close((int)file);
+}
+
+#endif
+
 LogTargetTextFile::LogTargetTextFile(const FILE_PATH_CHAR* location_path,
-	const FILE_PATH_CHAR* file_name_prefix, LogLevel lvl)
-	: LogTargetBase(lvl)
+	const FILE_PATH_CHAR* file_name_prefix, LogLevel lvl, LogFlushPolicy flush_policy, unsigned flush_value)
+	: LogTargetBase(lvl), flushPolicy(flush_policy), flushValue(flush_value),
+	flushStop(false), cleanupRequest(false), cleanupStop(false), cleanupStarted(false), fileHandle(-1), fileBufUsed(0), fileSegment(0), fileSize(0), filePreallocated(false)
 {
 	status = -1;
 	if (LisFileSys::DirExistCheck(NULL, location_path, true)) {
@@ -242,29 +790,321 @@ LogTargetTextFile::LogTargetTextFile(const FILE_PATH_CHAR* location_path,
 			location += FILE_PATH_SEPARATOR_CHR;
 		status = 0;
 		if (file_name_prefix) fileNamePrefix = file_name_prefix;
+		fileBuf.reset(new char[LogFileBufferSize]);
+		if (lfpPeriodic == flushPolicy && flushValue > 0) FlushTaskStart();
+	}
+}
+
+LogTargetTextFile::~LogTargetTextFile()
+{
+	{
+		std::lock_guard<std::mutex> sync_lock(fileSync);
+		flushStop = true;
+		flushWake.notify_all();
 	}
+	{
+		std::lock_guard<std::mutex> sync_lock(cleanupSync);
+		cleanupStop = true;
+		cleanupWake.notify_all();
+	}
+	cleanupTask.StopTask("flush");
+	cleanupTask.StopTask("cleanup");
+	std::lock_guard<std::mutex> sync_lock(fileSync);
+	FileClose();
+}
+
+void LogTargetTextFile::FlushTaskStart()
+{
+	// The events only check the period on arrival, the task writes out the data of the idle target
+	cleanupTask.StartTask("flush", [this](LisThread::TaskProcCtrl* proc_ctrl, LisThread::TaskWorkData work_data) {
+		std::unique_lock<std::mutex> sync_lock(fileSync);
+		while (!flushStop) {
+			auto flush_time = fileLastFlush + std::chrono::milliseconds(flushValue);
+			if (std::chrono::system_clock::now() >= flush_time) {
+				FileFlush();
+				flush_time = fileLastFlush + std::chrono::milliseconds(flushValue);
+			}
+			flushWake.wait_until(sync_lock, flush_time);
+		}
+		return 0;
+	}, nullptr);
 }
 
-LogTargetTextFile::~LogTargetTextFile() { }
+void LogTargetTextFile::SetRotation(const LogFileRotation& settings)
+{
+	{
+		std::lock_guard<std::mutex> sync_lock(fileSync);
+		rotation = settings;
+		FileCleanupRequest();
+	}
+	if (settings.KeepCount > 0 || settings.KeepDays > 0) CleanupTaskStart();
+}
 
 std::basic_string<FILE_PATH_CHAR> LogTargetTextFile::GetFilePath(
-	std::chrono::system_clock::time_point time) const
+	std::chrono::system_clock::time_point time, unsigned segment) const
 {
 	char buf[0xFF];
-	GetTimeStr(time, buf, sizeof(buf), TimeFormat_FileName, nullptr);
+	int len = GetTimeStr(time, buf, sizeof(buf), TimeFormat_FileName, nullptr);
+	if (segment > 0) { // insert the segment number before the extension
+		char* ext = std::strrchr(buf, '.');
+		std::string ext_str = ext ? ext : "";
+		std::snprintf(ext ? ext : buf + len, sizeof(buf) - (ext ? ext - buf : len), ".%u%s", segment, ext_str.c_str());
+	}
 	std::basic_string<FILE_PATH_CHAR> result = location;
 	result += fileNamePrefix;
 	result += (FILE_PATH_CHAR*)LisStr::CStrConvert(buf);
 	return result;
 }
 
+static size_t LogFileNamePos(const std::basic_string<FILE_PATH_CHAR>& path)
+{
+	auto name_pos = path.find_last_of(FILE_PATH_SEPARATOR_CHR);
+	return (std::string::npos == name_pos) ? 0 : name_pos + 1;
+}
+
+// Parses the file name of the target "<prefix><date per TimeFormat_FileName>[.<segment>]<extension>"
+// (the name starts at name_pos of the path), the date specifiers are matched as digits.
+// Returns false if the name is not of the target (other prefix, the other logger's files)
+static bool LogFileNameParse(const std::basic_string<FILE_PATH_CHAR>& path, size_t name_pos,
+	const std::basic_string<FILE_PATH_CHAR>& prefix, size_t& date_len, unsigned& segment)
+{
+	size_t len = path.length(), pos = name_pos + prefix.length();
+	if (len < pos || 0 != path.compare(name_pos, prefix.length(), prefix)) return false;
+	const char* fmt = TimeFormat_FileName;
+	const char* ext = std::strrchr(fmt, '.');
+	if (!ext) ext = fmt + std::strlen(fmt);
+	for (; fmt < ext; ++fmt) {
+		if ('%' != *fmt) {
+			if (pos >= len || (FILE_PATH_CHAR)*fmt != path[pos++]) return false;
+			continue;
+		}
+		unsigned digits;
+		switch (*++fmt) {
+		case 'Y': digits = 4; break;
+		case 'j': digits = 3; break;
+		case 'y': case 'm': case 'd': case 'H': case 'M': case 'S': digits = 2; break;
+		default: return false; // not supported in the file names
+		}
+		for (; digits > 0; --digits, ++pos)
+			if (pos >= len || path[pos] < '0' || path[pos] > '9') return false;
+	}
+	date_len = pos - name_pos - prefix.length();
+	segment = 0;
+	if (pos + 1 < len && '.' == path[pos] && path[pos + 1] >= '0' && path[pos + 1] <= '9') {
+		unsigned num = 0;
+		size_t num_pos = pos + 1;
+		for (; num_pos < len && path[num_pos] >= '0' && path[num_pos] <= '9'; ++num_pos)
+			num = num * 10 + (path[num_pos] - '0');
+		if (len - num_pos == std::strlen(ext)) { // ".<segment><extension>" or the date followed by digits
+			pos = num_pos;
+			segment = num;
+		}
+	}
+	if (len - pos != std::strlen(ext)) return false;
+	for (; pos < len; ++pos, ++ext)
+		if ((FILE_PATH_CHAR)*ext != path[pos]) return false;
+	return true;
+}
+
+bool LogTargetTextFile::FileOpen(std::chrono::system_clock::time_point time)
+{
+	FileClose();
+	FileCleanupRequest(); // the day changed
+	// The file covers a day: [midnight, next midnight)
+	std::tm tm;
+	LogLocalTime(std::chrono::system_clock::to_time_t(time), &tm);
+	tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+	tm.tm_isdst = -1;
+	fileTimeBegin = std::chrono::system_clock::from_time_t(std::mktime(&tm));
+	++tm.tm_mday;
+	tm.tm_isdst = -1;
+	fileTimeEnd = std::chrono::system_clock::from_time_t(std::mktime(&tm));
+	unsigned segment = 0; // continue the last existing segment of the day
+	size_t day_date_len, date_len;
+	unsigned num;
+	auto day_path = GetFilePath(fileTimeBegin);
+	if (rotation.MaxSegmentSize > 0
+		&& LogFileNameParse(day_path, location.length(), fileNamePrefix, day_date_len, num)) {
+		size_t date_pos = location.length() + fileNamePrefix.length();
+		LisFileSys::DirEnum([&](const LisFileSys::FileEntry& file) {
+			size_t name_pos = LogFileNamePos(file.Path);
+			if (LogFileNameParse(file.Path, name_pos, fileNamePrefix, date_len, num) && date_len == day_date_len
+				&& 0 == file.Path.compare(name_pos + fileNamePrefix.length(), date_len, day_path, date_pos, date_len)
+				&& num > segment)
+				segment = num;
+			return true;
+		}, location.c_str());
+	}
+	return FileOpenSegment(segment);
+}
+
+bool LogTargetTextFile::FileOpenSegment(unsigned segment)
+{
+	fileSegment = segment;
+	fileHandle = LogFileOpen(GetFilePath(fileTimeBegin, segment).c_str());
+	fileLastFlush = std::chrono::system_clock::now();
+	if (fileHandle < 0) return false;
+	fileSize = LogFileSize(fileHandle);
+	filePreallocated = false;
+	if (rotation.MaxSegmentSize > 0 && rotation.Preallocate && fileSize < rotation.MaxSegmentSize)
+		filePreallocated = LogFilePreallocate(fileHandle, rotation.MaxSegmentSize);
+	return true;
+}
+
+void LogTargetTextFile::FileClose()
+{
+	if (fileHandle < 0) return;
+	FileFlush();
+	LogFileClose(fileHandle, filePreallocated);
+	fileHandle = -1;
+}
+
+void LogTargetTextFile::FileCleanupRequest()
+{
+	if (0 == rotation.KeepCount && 0 == rotation.KeepDays) return;
+	std::lock_guard<std::mutex> sync_lock(cleanupSync);
+	cleanupRotation = rotation;
+	cleanupRequest = true; // a request pending or made during the run is coalesced with this one
+	cleanupWake.notify_one();
+}
+
+void LogTargetTextFile::CleanupTaskStart()
+{
+	{
+		std::lock_guard<std::mutex> sync_lock(cleanupSync);
+		if (cleanupStarted) return;
+		cleanupStarted = true;
+	}
+	cleanupTask.StartTask("cleanup", [this](LisThread::TaskProcCtrl* proc_ctrl, LisThread::TaskWorkData work_data) {
+		std::unique_lock<std::mutex> sync_lock(cleanupSync);
+		for (;;) {
+			cleanupWake.wait(sync_lock, [this]() { return cleanupRequest || cleanupStop; });
+			if (cleanupStop) break;
+			cleanupRequest = false;
+			LogFileRotation settings = cleanupRotation;
+			sync_lock.unlock();
+			FileCleanup(settings, proc_ctrl);
+			sync_lock.lock();
+		}
+		return 0;
+	}, nullptr);
+}
+
+void LogTargetTextFile::FileCleanup(const LogFileRotation& settings, const LisThread::TaskProcCtrl* proc_ctrl)
+{
+	auto keep_time = std::time(nullptr) - (std::time_t)settings.KeepDays * 24 * 60 * 60;
+	std::vector<std::pair<std::time_t, std::basic_string<FILE_PATH_CHAR>>> files;
+	LisFileSys::DirEnum([&](const LisFileSys::FileEntry& file) {
+		size_t date_len;
+		unsigned segment;
+		if (LogFileNameParse(file.Path, LogFileNamePos(file.Path), fileNamePrefix, date_len, segment))
+			files.emplace_back(file.Info.Changed, file.Path);
+		return !proc_ctrl->StopFlag;
+	}, location.c_str(), NULL, (LisFileSys::DirEnumOptions)(LisFileSys::deoFiles | LisFileSys::deoFileInfo));
+	std::sort(files.begin(), files.end(), // the newest first; same time - the later segment first
+		[](const decltype(files)::value_type& a, const decltype(files)::value_type& b) {
+			if (a.first != b.first) return a.first > b.first;
+			if (a.second.length() != b.second.length()) return a.second.length() > b.second.length();
+			return a.second > b.second;
+		});
+	for (size_t i = 0; i < files.size() && !proc_ctrl->StopFlag; ++i) {
+		if ((settings.KeepCount > 0 && i >= settings.KeepCount) || (settings.KeepDays > 0 && files[i].first < keep_time))
+			LisFileSys::FileDelete(files[i].second.c_str());
+	}
+}
+
+void LogTargetTextFile::FileAppend(const char* data, size_t len)
+{
+	if (rotation.MaxSegmentSize > 0 && fileSize > 0 && fileSize + len > rotation.MaxSegmentSize) {
+		FileClose(); // the segment is full, continue in the next one
+		if (!FileOpenSegment(fileSegment + 1)) return; // ERROR: can't open the file
+		FileCleanupRequest();
+	}
+	fileSize += len;
+	if (fileBufUsed + len > LogFileBufferSize) FileFlush();
+	if (len >= LogFileBufferSize) { // too big to be buffered
+		LogFileWrite(fileHandle, data, len);
+		return;
+	}
+	std::memcpy(fileBuf.get() + fileBufUsed, data, len);
+	fileBufUsed += len;
+}
+
+void LogTargetTextFile::FileBatchAppend(const char* data, size_t len)
+{
+	if (rotation.MaxSegmentSize > 0 && fileSize > 0 && fileSize + len > rotation.MaxSegmentSize) {
+		FileClose(); // the segment is full, continue in the next one
+		if (!FileOpenSegment(fileSegment + 1)) return; // ERROR: can't open the file
+		FileCleanupRequest();
+	}
+	fileSize += len;
+	fileBatch.append(data, len);
+}
+
+void LogTargetTextFile::FileFlush()
+{
+	if ((fileBufUsed > 0 || !fileBatch.empty()) && fileHandle >= 0)
+		LogFileWrite(fileHandle, fileBuf.get(), fileBufUsed, fileBatch.data(), fileBatch.size());
+	fileBufUsed = 0;
+	fileBatch.clear();
+	fileLastFlush = std::chrono::system_clock::now();
+}
+
 void LogTargetTextFile::WriteEvent(const LogEvent& evt)
 {
-	// TODO: probably some optmization needed & file concurrent (multithread) access
-	std::ofstream ofs(GetFilePath(evt.Time).c_str(),
-		std::ios_base::out | std::ios::binary | std::ios_base::app);
-	WriteEventAsText(evt, [&ofs](EventType type, const char* txt) { ofs << txt; }, true);
-	ofs.close();
+	if (0 != status) return;
+	std::lock_guard<std::mutex> sync_lock(fileSync);
+	if ((fileHandle < 0 || evt.Time >= fileTimeEnd || evt.Time < fileTimeBegin) && !FileOpen(evt.Time))
+		return; // ERROR: can't open the file
+	FormatEvent(evt, [this](EventType type, const char* txt) { FileAppend(txt, std::strlen(txt)); });
+	switch (flushPolicy) {
+	case lfpBytes:
+		if (fileBufUsed >= flushValue) FileFlush();
+		break;
+	case lfpPeriodic:
+		if (evt.Time - fileLastFlush >= std::chrono::milliseconds(flushValue)) FileFlush();
+		break;
+	default: // lfpEvent
+		FileFlush();
+	}
+}
+
+void LogTargetTextFile::WriteEvents(const LogEvent* events, size_t count)
+{
+	if (0 != status || 0 == count) return;
+	std::lock_guard<std::mutex> sync_lock(fileSync);
+	for (size_t i = 0; i < count; ++i) {
+		const LogEvent& evt = events[i];
+		if (evt.Level < logLevel) continue;
+		if ((fileHandle < 0 || evt.Time >= fileTimeEnd || evt.Time < fileTimeBegin) && !FileOpen(evt.Time))
+			continue; // ERROR: can't open the file
+		FormatEvent(evt, [this](EventType type, const char* txt) { FileBatchAppend(txt, std::strlen(txt)); });
+	}
+	// The buffer and the batch text are written by single call, or the batch text is buffered
+	size_t used = fileBufUsed + fileBatch.size();
+	bool is_flush;
+	switch (flushPolicy) {
+	case lfpBytes:
+		is_flush = used >= flushValue;
+		break;
+	case lfpPeriodic:
+		is_flush = events[count - 1].Time - fileLastFlush >= std::chrono::milliseconds(flushValue);
+		break;
+	default: // lfpEvent
+		is_flush = true;
+	}
+	if (is_flush || used > LogFileBufferSize) FileFlush();
+	else if (!fileBatch.empty()) {
+		std::memcpy(fileBuf.get() + fileBufUsed, fileBatch.data(), fileBatch.size());
+		fileBufUsed = used;
+		fileBatch.clear();
+	}
+}
+
+void LogTargetTextFile::Flush()
+{
+	std::lock_guard<std::mutex> sync_lock(fileSync);
+	FileFlush();
 }
 
 } // namespace LisLog
@@ -3,16 +3,45 @@
 #ifndef _LIS_LOGGER_H_
 #define _LIS_LOGGER_H_
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <ctime>
 #include <functional>
+#include <initializer_list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
+#include "Delegate.h"
 #include "FileSystem.h"
+#include "LogClock.h"
+#include "SyncSnapshot.h"
+#include "ThreadTaskMgr.h"
 
 namespace LisLog {
 
 enum LogLevel { llTrace = 0, llDebug = 1, llInfo = 2, llWarn = 3, llError = 4, llFault = 5, llNone = 6 };
 
+// Lowest level of the events compiled in by the LOG_... macros, calls below it are removed entirely
+#ifndef LIS_LOG_LEVEL_MIN
+#ifdef NDEBUG
+#define LIS_LOG_LEVEL_MIN 2 // llInfo
+#else
+#define LIS_LOG_LEVEL_MIN 0 // llTrace
+#endif
+#endif
+
+// Compile time check of printf-like format string and arguments
+#if defined(__GNUC__) || defined(__clang__)
+#define LIS_PRINTF_FMT(fmt_idx, args_idx) __attribute__((format(printf, fmt_idx, args_idx)))
+#else
+#define LIS_PRINTF_FMT(fmt_idx, args_idx)
+#endif
+
 extern const char* TimeFormat_String;
 extern const char* TimeFormat_Milliseconds;
 
@@ -24,7 +53,7 @@ class LogTargetBase
 {
 public:
 	enum EventType { etGeneral, etSubsequent };
-	typedef std::function<void(EventType type, const char* txt)> TextWriteFunc;
+	typedef Delegate<void(EventType type, const char* txt)> TextWriteFunc;
 protected:
 	int status;
 	LogLevel logLevel;
@@ -36,76 +65,391 @@ protected:
 		LogLevel Level;
 		std::chrono::system_clock::time_point Time;
 		const char* Data;
+		const char* Fields; // structured event fields as JSON object members ("key":value,...) or nullptr
 	};
 
 	virtual void WriteEvent(const LogEvent& evt) = 0;
+	// Batch of the events (in order), the target may coalesce the writes; by default calls WriteEvent
+	// for each event of the target's level
+	virtual void WriteEvents(const LogEvent* events, size_t count);
+	virtual void Flush() { } // write out the buffered data (if any)
 
 	static int GetTimeStr(std::chrono::system_clock::time_point tp, char* buf, size_t len,
 		const char* tm_fmt = TimeFormat_String, const char* ms_fmt = TimeFormat_Milliseconds);
 	static void WriteEventAsText(const LogEvent& evt, TextWriteFunc func, bool add_newline);
 
 	friend class Logger;
+	friend class BinLogReader;
 public:
 	virtual ~LogTargetBase() { }
 	int GetStatus() const { return status; }
 };
 
+// ******************************************* LogField ********************************************
+
+// Typed key/value of the structured event; the key and the string value are referenced, not copied
+// (they must be valid during the log call). Usage: { "user", name }, { "elapsed_ms", 12.5 }
+struct LogField
+{
+	enum FieldType { lftInt, lftUInt, lftDouble, lftBool, lftStr };
+	struct StrValue { const char* Ptr; size_t Len; };
+
+	const char* Key;
+	FieldType Type;
+	union {
+		long long Int;
+		unsigned long long UInt;
+		double Dbl;
+		bool Bool;
+		StrValue Str;
+	};
+
+	LogField(const char* key, int value) : Key(key), Type(lftInt), Int(value) { }
+	LogField(const char* key, long value) : Key(key), Type(lftInt), Int(value) { }
+	LogField(const char* key, long long value) : Key(key), Type(lftInt), Int(value) { }
+	LogField(const char* key, unsigned value) : Key(key), Type(lftUInt), UInt(value) { }
+	LogField(const char* key, unsigned long value) : Key(key), Type(lftUInt), UInt(value) { }
+	LogField(const char* key, unsigned long long value) : Key(key), Type(lftUInt), UInt(value) { }
+	LogField(const char* key, double value) : Key(key), Type(lftDouble), Dbl(value) { }
+	LogField(const char* key, bool value) : Key(key), Type(lftBool), Bool(value) { }
+	LogField(const char* key, const char* value) : Key(key), Type(lftStr) {
+		Str.Ptr = value ? value : "";
+		Str.Len = value ? std::char_traits<char>::length(value) : 0;
+	}
+	LogField(const char* key, const std::string& value) : Key(key), Type(lftStr) {
+		Str.Ptr = value.data();
+		Str.Len = value.length();
+	}
+};
+
+typedef std::initializer_list<LogField> LogFields;
+
 // *************************************** ILogger interface ***************************************
 
 class ILogger
 {
+protected:
+	std::atomic<LogLevel> lowestLogLevel;
+	ILogger() : lowestLogLevel(llNone) { }
 public:
 	typedef LogTargetBase* TargetHandle;
 
+	// Cheap check (not virtual) if the event of the level would be written to any target
+	bool IsLevelOn(LogLevel lvl) const {
+		return (lvl >= lowestLogLevel.load(std::memory_order_relaxed)) && (lvl < llNone);
+	}
+
 	virtual LogLevel GetCurrentLogLevel() = 0;
+	// Lowest level of the events written by this logger (the events go to the targets of their levels)
+	virtual void SetLevel(LogLevel lvl) = 0;
+
+	// Named child logger ("<this logger name>.<name>", e.g. "net.http"): shares the targets, has own level
+	// (inherited from the nearest configured parent); exists while the root logger exists
+	virtual ILogger* GetModule(const char* name) = 0;
 
 	virtual TargetHandle AddTarget(LogTargetBase* target) = 0;
 	virtual const LogTargetBase* GetTarget(int index) const = 0;
 	virtual bool DelTarget(TargetHandle target) = 0;
 
 	virtual void LogTxt(LogLevel lvl, const char* text) = 0;
-	virtual int LogFmt(LogLevel lvl, const char* format, ...) = 0;
+	LIS_PRINTF_FMT(3, 4) virtual int LogFmt(LogLevel lvl, const char* format, ...) = 0;
 	virtual void LogHex(LogLevel lvl, const char* text, const unsigned char* data, size_t size) = 0;
+	// Structured event: the message text and the fields (serialized without heap allocations)
+	virtual void LogStruct(LogLevel lvl, const char* text, LogFields fields) = 0;
+
+	// Waits until all the events logged so far are written by the targets
+	virtual void Flush() = 0;
 
 	virtual ~ILogger() {};
 };
 
+// **************************************** LogRateLimiter *****************************************
+
+// Limits the events rate (GCRA, equivalent to the token bucket): on average rate events per second,
+// up to burst events at once. Allow() is lock-free, the suppressed call only reads the clock
+// and the shared state (plus relaxed counter increment).
+class LogRateLimiter
+{
+	std::atomic<int64_t> nextTime; // theoretical arrival time (ns) of the next event
+	int64_t interval, tolerance; // ns, interval 0 - not limited
+	std::atomic<uint64_t> suppressed;
+public:
+	explicit LogRateLimiter(unsigned rate = 0, unsigned burst = 1) : nextTime(0), suppressed(0) { Setup(rate, burst); }
+	LogRateLimiter(const LogRateLimiter&) = delete;
+	LogRateLimiter& operator=(const LogRateLimiter&) = delete;
+
+	// Not thread safe, call before use; rate 0 - not limited
+	void Setup(unsigned rate, unsigned burst) {
+		interval = rate ? 1000000000LL / rate : 0;
+		tolerance = interval * (burst ? burst - 1 : 0);
+	}
+
+	bool Allow() {
+		if (0 == interval) return true;
+		int64_t now = Now();
+		int64_t next = nextTime.load(std::memory_order_relaxed);
+		for (;;) {
+			int64_t base = (next > now) ? next : now;
+			if (base - now > tolerance) {
+				suppressed.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			if (nextTime.compare_exchange_weak(next, base + interval, std::memory_order_relaxed)) return true;
+		}
+	}
+
+	uint64_t GetSuppressed() const { return suppressed.load(std::memory_order_relaxed); }
+
+	// Monotonic time (ns), coarse clock is used where available (it's several times cheaper)
+	static int64_t Now() {
+#ifdef CLOCK_MONOTONIC_COARSE
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+		return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+};
+
+// Rate limiter of the call site (see LOG_FMT_LIMIT), registered in the global list of the sites
+struct LogSiteStats { const char* File; unsigned Line; uint64_t Suppressed; };
+
+class LogSiteLimiter : public LogRateLimiter
+{
+	static std::atomic<LogSiteLimiter*> first;
+	LogSiteLimiter* next;
+	const char* file;
+	unsigned line;
+public:
+	LogSiteLimiter(unsigned rate, unsigned burst, const char* file_name, unsigned line_num);
+	// The suppressed events counts of all the call sites (constructed so far)
+	static void GetStats(std::vector<LogSiteStats>& stats);
+};
+
 // ************************************ ILogger implementation *************************************
 
+// What to do when the async events queue is full
+enum LogOverflowPolicy {
+	lopBlock, // wait for the free place in the queue
+	lopDropNewest, // discard the event being logged
+	lopDropOldest // discard the oldest queued event
+};
+
 struct LoggerSettings
 {
 	// general log settings
+	// events are queued and written to the targets by the background thread (the events logged and Flush
+	// called by the targets on that thread are written / flushed at once)
+	bool AsyncMode = false;
+	unsigned AsyncQueueSize = 0x400; // events count (rounded up to the power of 2)
+	LogOverflowPolicy AsyncOverflow = lopBlock;
+	LogClockType Clock = lctSystem; // events time source
+
+	// flood protection (per level, applied before the message is formatted)
+	struct RateLimit { unsigned Rate = 0, Burst = 1; }; // events per second, 0 - not limited
+	RateLimit LevelRateLimit[llNone];
+	unsigned LevelSampleRate[llNone] = { 1, 1, 1, 1, 1, 1 }; // 1 of N events is written (per thread)
+	// the repeated message (same level and text, per thread) is replaced with the summary
+	// "Last message repeated N times", written before the next different message,
+	// or every RepeatReportMs while the repetitions continue (the pending one - by Flush and on shutdown)
+	bool SuppressRepeats = false;
+	unsigned RepeatReportMs = 10000;
+};
+
+struct LogQueueStats {
+	uint64_t Pushed, DroppedNewest, DroppedOldest;
+	uint64_t DroppedNoMemory; // the long texts not copied (no memory), counted in Pushed as well
+	uint64_t Blocked;
 };
+struct LogSuppressStats { uint64_t RateLimited, Sampled, Repeated; };
 
 const int LogMsgTxtMaxLen = 0x26A0;
 
+class LogEventQueue;
+class LoggerModule;
+
 class Logger : public ILogger
 {
 	LoggerSettings settings;
-	LogLevel lowestLogLevel;
-	std::vector<std::unique_ptr<LogTargetBase>> targets;
-	std::chrono::system_clock::time_point lastEventTime; // TODO: value should depend on thread (+ class instance) //thread_local
+	LogClock clock;
+	typedef std::vector<LogTargetBase*> TargetList;
+	typedef LisThread::SnapshotPtr<TargetList> TargetSnapshot;
+	TargetSnapshot targets; // read by logging threads without locks
+	std::vector<std::unique_ptr<LogTargetBase>> targetsOwned; // changed under the targets update only
 	bool LogLvlChk(LogLevel event_level, LogLevel target_level);
-	void WriteEvent(LogTargetBase::EventType typ, LogLevel lvl, const char* txt);
+	bool LogLimitChk(LogLevel lvl);
+	void WriteGeneral(LogLevel lvl, const char* txt, bool coalesce, const char* fields = nullptr);
+	void WriteEvent(LogTargetBase::EventType typ, LogLevel lvl, const char* txt, const char* fields = nullptr);
+	void DispatchEvent(const LogTargetBase::LogEvent& evt);
+	void DispatchEvents(const LogTargetBase::LogEvent* events, size_t count);
+
+	std::unique_ptr<LogEventQueue> asyncQueue;
+	std::thread* asyncThread;
+	std::atomic<bool> asyncStopFlag;
+	std::atomic<unsigned> flushRequest, flushDone;
+	std::mutex flushSync;
+	std::condition_variable flushWake; // the async thread signals flushDone
+	bool IsAsyncThread() const { return asyncThread && std::this_thread::get_id() == asyncThread->get_id(); }
+	static void AsyncMainProc(Logger* logger);
+
+	// Levels: the effective levels (lowestLogLevel) of the root and the modules are recalculated
+	// on any levels or targets change
+	std::mutex levelsSync;
+	LogLevel rootLevel;
+	std::map<std::string, std::unique_ptr<LoggerModule>> modules;
+	std::map<std::string, LogLevel> moduleLevels; // configured levels
+	LogLevel GetConfiguredLevel(const std::string& name) const;
+	void UpdateLevels(); // levelsSync must be locked
+	void SetModuleLevel(const std::string& name, LogLevel lvl);
+
+	void LogTxtChk(LogLevel min_lvl, LogLevel lvl, const char* text);
+	int LogFmtChk(LogLevel min_lvl, LogLevel lvl, const char* format, std::va_list args);
+	void LogHexChk(LogLevel min_lvl, LogLevel lvl, const char* text, const unsigned char* data, size_t size);
+	void LogStructChk(LogLevel min_lvl, LogLevel lvl, const char* text, LogFields fields);
+	friend class LoggerModule;
+
+	bool limitsOn; // any rate limit or sampling is set
+	LogRateLimiter levelLimiters[llNone];
+	std::atomic<uint64_t> cntSampled, cntRepeated;
+	// The repeats suppression state of the threads, pending summaries are written by Flush
+	struct RepeatState {
+		std::mutex Sync; // the thread vs Flush, not contended
+		LogLevel Level; // llNone - nothing to compare
+		std::string Text;
+		unsigned Count; // repeats suppressed since the summary
+		int64_t Since; // time of the first suppressed repeat
+		RepeatState() : Level(llNone), Count(0), Since(0) { }
+	};
+	const uint64_t instanceId; // the threads cache the state of the logger instance
+	std::mutex repeatsSync;
+	std::vector<std::shared_ptr<RepeatState>> repeatStates;
+	RepeatState& GetRepeatState();
+	void WriteRepeatSummary(RepeatState& state); // state.Sync must be locked
+	void FlushRepeats();
+
+	static ILogger* singleton;
 
 	Logger(LoggerSettings settings); // hide possibility to instantiate directly
 public:
 	static int InitSingleton(LoggerSettings settings, LogTargetBase* targets[], size_t target_count);
-	static ILogger* GetInstance();
+	static ILogger* GetInstance() {
+		if (!singleton)
+			InitSingleton(LoggerSettings(), nullptr, 0); // is it necessary?
+		return singleton;
+	}
 
 	virtual ~Logger();
 
 	virtual LogLevel GetCurrentLogLevel() override;
+	virtual void SetLevel(LogLevel lvl) override;
+	virtual ILogger* GetModule(const char* name) override;
 
 	virtual TargetHandle AddTarget(LogTargetBase* target) override;
 	virtual const LogTargetBase* GetTarget(int index) const override;
 	virtual bool DelTarget(TargetHandle target) override;
 
 	void LogTxt(LogLevel lvl, const char* text) override;
-	int LogFmt(LogLevel lvl, const char* format, ...) override;
+	LIS_PRINTF_FMT(3, 4) int LogFmt(LogLevel lvl, const char* format, ...) override;
 	void LogHex(LogLevel lvl, const char* text, const unsigned char* data, size_t size) override;
+	void LogStruct(LogLevel lvl, const char* text, LogFields fields) override;
+
+	void Flush() override;
+	bool GetAsyncStats(LogQueueStats& stats) const;
+	void GetSuppressStats(LogSuppressStats& stats) const; // per level limits only, see LogSiteLimiter::GetStats
 };
 
+// Child logger of the Logger (see ILogger::GetModule)
+class LoggerModule : public ILogger
+{
+	Logger& root;
+	std::string moduleName;
+
+	LoggerModule(Logger& owner, const std::string& name) : root(owner), moduleName(name) { }
+	friend class Logger;
+public:
+	const std::string& GetName() const { return moduleName; }
+
+	virtual LogLevel GetCurrentLogLevel() override { return lowestLogLevel; }
+	virtual void SetLevel(LogLevel lvl) override;
+	virtual ILogger* GetModule(const char* name) override;
+
+	virtual TargetHandle AddTarget(LogTargetBase* target) override { return root.AddTarget(target); }
+	virtual const LogTargetBase* GetTarget(int index) const override { return root.GetTarget(index); }
+	virtual bool DelTarget(TargetHandle target) override { return root.DelTarget(target); }
+
+	void LogTxt(LogLevel lvl, const char* text) override { root.LogTxtChk(lowestLogLevel, lvl, text); }
+	LIS_PRINTF_FMT(3, 4) int LogFmt(LogLevel lvl, const char* format, ...) override;
+	void LogHex(LogLevel lvl, const char* text, const unsigned char* data, size_t size) override {
+		root.LogHexChk(lowestLogLevel, lvl, text, data, size);
+	}
+	void LogStruct(LogLevel lvl, const char* text, LogFields fields) override {
+		root.LogStructChk(lowestLogLevel, lvl, text, fields);
+	}
+
+	void Flush() override { root.Flush(); }
+};
+
+// **************************************** Logging macros *****************************************
+
+// The arguments are evaluated only if the level is on (both compile time and run time checks passed).
+// Usage: LOG_DBG("%s: %d items", name, CountItems());
+#define LOG_LVL_ON(lvl) (((lvl) >= LIS_LOG_LEVEL_MIN) && LisLog::Logger::GetInstance()->IsLevelOn(lvl))
+
+#define LOG_TXT(lvl, text) LOG_TXT_TO(LisLog::Logger::GetInstance(), lvl, text)
+#define LOG_FMT(lvl, ...) LOG_FMT_TO(LisLog::Logger::GetInstance(), lvl, __VA_ARGS__)
+
+// Same for the given logger (module), e.g.: auto http_log = Logger::GetInstance()->GetModule("net.http");
+// LOG_FMT_TO(http_log, LisLog::llDebug, "Request: %s", url);
+// The module is deleted with the root logger, so don't keep it in a static across InitSingleton calls
+#define LOG_TXT_TO(logger, lvl, text) do { \
+	if ((lvl) >= LIS_LOG_LEVEL_MIN) { \
+		LisLog::ILogger* lis_logger_ = (logger); \
+		if (lis_logger_->IsLevelOn(lvl)) lis_logger_->LogTxt(lvl, text); \
+	} \
+} while (0)
+
+#define LOG_FMT_TO(logger, lvl, ...) do { \
+	if ((lvl) >= LIS_LOG_LEVEL_MIN) { \
+		LisLog::ILogger* lis_logger_ = (logger); \
+		if (lis_logger_->IsLevelOn(lvl)) lis_logger_->LogFmt(lvl, __VA_ARGS__); \
+	} \
+} while (0)
+
+#define LOG_HEX(lvl, text, data, size) do { \
+	if ((lvl) >= LIS_LOG_LEVEL_MIN) { \
+		LisLog::ILogger* lis_logger_ = LisLog::Logger::GetInstance(); \
+		if (lis_logger_->IsLevelOn(lvl)) lis_logger_->LogHex(lvl, text, data, size); \
+	} \
+} while (0)
+
+// Per call site rate limit: on average rate events per second, up to burst at once
+// (the suppressed counts of the sites are reported by LogSiteLimiter::GetStats)
+// Usage: LOG_FMT_LIMIT(LisLog::llError, 10, 20, "Connect failed: %d", err);
+#define LOG_FMT_LIMIT(lvl, rate, burst, ...) do { \
+	if ((lvl) >= LIS_LOG_LEVEL_MIN) { \
+		static LisLog::LogSiteLimiter lis_limiter_(rate, burst, __FILE__, __LINE__); \
+		LisLog::ILogger* lis_logger_ = LisLog::Logger::GetInstance(); \
+		if (lis_logger_->IsLevelOn(lvl) && lis_limiter_.Allow()) lis_logger_->LogFmt(lvl, __VA_ARGS__); \
+	} \
+} while (0)
+
+// Usage: LOG_STRUCT(LisLog::llInfo, "Request done", { "user", name }, { "elapsed_ms", ms });
+#define LOG_STRUCT(lvl, text, ...) do { \
+	if ((lvl) >= LIS_LOG_LEVEL_MIN) { \
+		LisLog::ILogger* lis_logger_ = LisLog::Logger::GetInstance(); \
+		if (lis_logger_->IsLevelOn(lvl)) lis_logger_->LogStruct(lvl, text, { __VA_ARGS__ }); \
+	} \
+} while (0)
+
+#define LOG_TRC(...) LOG_FMT(LisLog::llTrace, __VA_ARGS__)
+#define LOG_DBG(...) LOG_FMT(LisLog::llDebug, __VA_ARGS__)
+#define LOG_INF(...) LOG_FMT(LisLog::llInfo, __VA_ARGS__)
+#define LOG_WRN(...) LOG_FMT(LisLog::llWarn, __VA_ARGS__)
+#define LOG_ERR(...) LOG_FMT(LisLog::llError, __VA_ARGS__)
+#define LOG_FLT(...) LOG_FMT(LisLog::llFault, __VA_ARGS__)
+
 // ***************************************** LogTarget... ******************************************
 
 class LogTargetDebugOut : public LogTargetBase
@@ -127,17 +471,77 @@ public:
 		: LogTargetBase(lvl), function(func), msgAddNewline(msg_add_newline) { }
 };
 
+// When the buffered file data is written out
+enum LogFlushPolicy {
+	lfpEvent, // after every event
+	lfpBytes, // when the buffered data size reaches the value (bytes)
+	lfpPeriodic // when the value (milliseconds) elapsed since the previous flush (checked on the events
+		// and by the target's background task, so the idle target is flushed as well)
+};
+
+const size_t LogFileBufferSize = 0x10000;
+
+// Size based rotation: the day file is split into segments "<prefix><date>.log", "<prefix><date>.1.log", ...
+struct LogFileRotation
+{
+	uint64_t MaxSegmentSize = 0; // 0 - not limited
+	bool Preallocate = true; // reserve MaxSegmentSize on disk for a new segment (if supported by OS)
+	// Retention, old files are deleted by the background task
+	unsigned KeepCount = 0; // the newest files count to keep, 0 - not limited
+	unsigned KeepDays = 0; // 0 - not limited
+};
+
 class LogTargetTextFile : public LogTargetBase
 {
 	std::basic_string<FILE_PATH_CHAR> location, fileNamePrefix;
+	LogFlushPolicy flushPolicy;
+	unsigned flushValue;
+	LogFileRotation rotation;
+	LisThread::ThreadTaskMgr cleanupTask;
+
+	std::mutex fileSync;
+	std::condition_variable flushWake; // the periodic flush task waiting, fileSync is used
+	bool flushStop;
+	// The cleanup task runs the requested cleanup, the requests made during the run are coalesced
+	std::mutex cleanupSync;
+	std::condition_variable cleanupWake;
+	LogFileRotation cleanupRotation; // the settings of the requested cleanup
+	bool cleanupRequest, cleanupStop, cleanupStarted;
+	intptr_t fileHandle; // file descriptor or OS handle, -1 if file isn't open
+	std::chrono::system_clock::time_point fileTimeBegin, fileTimeEnd; // time period of the current file
+	std::chrono::system_clock::time_point fileLastFlush;
+	std::unique_ptr<char[]> fileBuf;
+	size_t fileBufUsed;
+	std::string fileBatch; // text of the events batch, written out together with the buffer
+	unsigned fileSegment;
+	uint64_t fileSize; // including the buffered data
+	bool filePreallocated;
+
+	bool FileOpen(std::chrono::system_clock::time_point time);
+	bool FileOpenSegment(unsigned segment);
+	void FileClose();
+	void FileCleanupRequest(); // fileSync must be locked
+	void CleanupTaskStart();
+	void FileCleanup(const LogFileRotation& settings, const LisThread::TaskProcCtrl* proc_ctrl);
+	void FileAppend(const char* data, size_t len);
+	void FileBatchAppend(const char* data, size_t len);
+	void FileFlush();
+	void FlushTaskStart();
 protected:
 	virtual void WriteEvent(const LogEvent& evt) override;
+	virtual void WriteEvents(const LogEvent* events, size_t count) override;
+	virtual void Flush() override;
+	// Renders the event as the file text (the line with the newline)
+	virtual void FormatEvent(const LogEvent& evt, TextWriteFunc func) { WriteEventAsText(evt, func, true); }
 public:
 	LogTargetTextFile(const FILE_PATH_CHAR* location_path,
-		const FILE_PATH_CHAR* file_name_prefix, LogLevel lvl = llInfo);
+		const FILE_PATH_CHAR* file_name_prefix, LogLevel lvl = llInfo,
+		LogFlushPolicy flush_policy = lfpEvent, unsigned flush_value = 0);
 	virtual ~LogTargetTextFile();
 
-	std::basic_string<FILE_PATH_CHAR> GetFilePath(std::chrono::system_clock::time_point time) const;
+	void SetRotation(const LogFileRotation& settings);
+	std::basic_string<FILE_PATH_CHAR> GetFilePath(
+		std::chrono::system_clock::time_point time, unsigned segment = 0) const;
 };
 
 } // namespace LisLog
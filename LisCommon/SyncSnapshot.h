@@ -0,0 +1,126 @@
+// ****** Copy-on-write snapshot pointer (RCU-like). (c) 2025 LISV ******
+#pragma once
+#ifndef _LIS_SYNC_SNAPSHOT_H_
+#define _LIS_SYNC_SNAPSHOT_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace LisThread {
+
+// ** Readers get the current immutable snapshot of the data without locks.
+// Writers (serialized by a mutex) copy the snapshot, modify the copy and publish it;
+// the replaced snapshots are deleted when no reader can use them anymore.
+// Readers are counted in two alternating groups, so the writer waiting for the readers
+// of the replaced snapshot is never starved by the new readers. A snapshot is deleted after
+// two group switches (each one after the old group has no readers) following its replacement,
+// so the updates that don't wait delete the snapshots too while the readers keep coming.
+// Without the updates the last replaced snapshots are kept: the owner deletes them by Reclaim
+// (e.g. TryReclaim on its read path after the ReadGuard is released).
+// Note: a thread holding ReadGuard must not call Update with wait_readers = true (deadlock).
+template <typename T>
+class SnapshotPtr
+{
+	std::atomic<T*> current;
+	mutable std::atomic<unsigned> readers[2];
+	std::atomic<unsigned> readersGroup;
+	std::mutex writeSync;
+	std::vector<std::pair<T*, unsigned>> retired; // replaced snapshots waiting for deletion, group switches
+	std::atomic<bool> hasRetired; // retired isn't empty (checked without the lock)
+	unsigned groupSwitches;
+
+	void ReclaimRetired(bool wait_readers)
+	{
+		if (retired.empty()) return;
+		for (int i = 0; i < 2; ++i) {
+			unsigned group = readersGroup.load();
+			while (0 != readers[group ^ 1].load()) { // the old group readers may use the replaced snapshots
+				if (!wait_readers) break;
+				std::this_thread::yield();
+			}
+			if (0 != readers[group ^ 1].load()) break; // try the next time
+			readersGroup.store(group ^ 1); // new readers go to the other group
+			++groupSwitches;
+		}
+		size_t kept = 0;
+		for (auto& item : retired) {
+			if (groupSwitches - item.second >= 2) delete item.first;
+			else retired[kept++] = item;
+		}
+		retired.resize(kept);
+		hasRetired.store(kept > 0, std::memory_order_relaxed);
+	}
+public:
+	class ReadGuard
+	{
+		const SnapshotPtr& owner;
+		unsigned group;
+		const T* data;
+	public:
+		explicit ReadGuard(const SnapshotPtr& ptr) : owner(ptr) {
+			group = owner.readersGroup.load(std::memory_order_relaxed) & 1;
+			owner.readers[group].fetch_add(1);
+			data = owner.current.load();
+		}
+		~ReadGuard() { owner.readers[group].fetch_sub(1, std::memory_order_release); }
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+
+		const T* get() const { return data; }
+		const T* operator->() const { return data; }
+		const T& operator*() const { return *data; }
+	};
+
+	explicit SnapshotPtr(T* data = new T()) : current(data), readersGroup(0), hasRetired(false), groupSwitches(0) {
+		readers[0] = 0;
+		readers[1] = 0;
+	}
+	~SnapshotPtr() {
+		for (auto& item : retired) delete item.first;
+		delete current.load();
+	}
+	SnapshotPtr(const SnapshotPtr&) = delete;
+	SnapshotPtr& operator=(const SnapshotPtr&) = delete;
+
+	// modify(T& copy) returns false if nothing was changed (the copy is discarded).
+	// wait_readers = false: the replaced snapshot is deleted later (by the next updates or destructor).
+	template <typename F>
+	bool Update(F modify, bool wait_readers = true)
+	{
+		std::lock_guard<std::mutex> sync_lock(writeSync);
+		T* data = new T(*current.load());
+		if (!modify(*data)) {
+			delete data;
+			return false;
+		}
+		retired.emplace_back(current.exchange(data), groupSwitches);
+		ReclaimRetired(wait_readers);
+		return true;
+	}
+
+	// Deletes the replaced snapshots no reader can use anymore, returns false if some are kept
+	bool Reclaim(bool wait_readers = false)
+	{
+		if (!hasRetired.load(std::memory_order_relaxed)) return true;
+		std::lock_guard<std::mutex> sync_lock(writeSync);
+		ReclaimRetired(wait_readers);
+		return retired.empty();
+	}
+	// Same without waiting, skipped if an update is in progress (for the read paths).
+	// Must not be called from Update's modify function
+	bool TryReclaim()
+	{
+		if (!hasRetired.load(std::memory_order_relaxed)) return true;
+		std::unique_lock<std::mutex> sync_lock(writeSync, std::try_to_lock);
+		if (!sync_lock) return false;
+		ReclaimRetired(false);
+		return retired.empty();
+	}
+};
+
+} // namespace LisThread
+
+#endif // #ifndef _LIS_SYNC_SNAPSHOT_H_
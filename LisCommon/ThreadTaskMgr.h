@@ -9,6 +9,7 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include "Delegate.h"
 
 namespace LisThread {
 
@@ -24,7 +25,7 @@ struct TaskProcCtrl {
 	TaskStopCallback StopFunc; // Optional function that should be called by task manager when the task is about to stop
 };
 typedef void* TaskWorkData;
-typedef std::function<TaskProcResult(TaskProcCtrl* proc_ctrl, TaskWorkData work_data)> TaskProc;
+typedef Delegate<TaskProcResult(TaskProcCtrl* proc_ctrl, TaskWorkData work_data)> TaskProc;
 typedef std::function<void(TaskProcResult proc_result)> TaskFinCallback;
 
 typedef std::chrono::system_clock::time_point TimeDataType;
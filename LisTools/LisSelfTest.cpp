@@ -0,0 +1,958 @@
+// ****** Library self test tool. (c) 2025 LISV ******
+// Usage: LisSelfTest [-d <work directory>] [<test name> ...]
+// Runs the behavioural checks of the library (round trips, concurrency, dispatch semantics), all the tests
+// or the named ones; prints the failed checks and the summary, the exit code is the failed tests count.
+// The files written by the tests are kept in the work directory (default: LisSelfTest) if the test failed.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../LisCommon/Delegate.h"
+#include "../LisCommon/EventDispBase.h"
+#include "../LisCommon/FileSystem.h"
+#include "../LisCommon/LogBinary.h"
+#include "../LisCommon/LogEventQueue.h"
+#include "../LisCommon/LogFileReader.h"
+#include "../LisCommon/LogStructured.h"
+#include "../LisCommon/Logger.h"
+#include "../LisCommon/StrUtils.h"
+#include "../LisCommon/SyncSnapshot.h"
+
+using namespace LisLog;
+
+enum SelfTestEvent { steFirst, steSecond, steThird };
+EVENT_TYPE_DENSE_RANGE(SelfTestEvent, steFirst, steThird);
+
+static std::atomic<int> SelfTest_FailCount(0); // the failed checks of the running test
+
+static void SelfTest_Fail(const char* file, int line, const char* cond)
+{
+	std::printf("  FAILED %s(%d): %s\n", file, line, cond);
+	++SelfTest_FailCount;
+}
+
+// Non-fatal check (the test goes on), may be used by the test threads
+#define SELF_CHECK(cond) do { if (!(cond)) SelfTest_Fail(__FILE__, __LINE__, #cond); } while (0)
+
+// ***************************************** LogEventQueue *****************************************
+
+// Producers push the numbered events concurrently, each producer's events must be popped once, in order
+static void SelfTest_LogEventQueue(const std::string& /*work_dir*/)
+{
+	const int ProducerCount = 4, EventCount = 20000, Capacity = 64;
+	LogEventQueue queue(Capacity, lopBlock);
+	std::vector<std::thread> producers;
+	for (int producer = 0; producer < ProducerCount; ++producer) {
+		producers.emplace_back([&queue, producer]() {
+			char txt[LogEventQueue::ItemTextInlineLen + 32];
+			for (int i = 0; i < EventCount; ++i) {
+				int len = std::snprintf(txt, sizeof(txt), "%d %d", producer, i);
+				if (0 == i % 100) { // the long text goes to the heap
+					std::memset(txt + len, 'x', LogEventQueue::ItemTextInlineLen);
+					txt[len + LogEventQueue::ItemTextInlineLen] = '\0';
+				}
+				SELF_CHECK(queue.Push(LogTargetBase::etGeneral, llInfo, i, txt, nullptr));
+			}
+		});
+	}
+	int next_seq[ProducerCount] = { };
+	LogEventQueue::Item item;
+	for (int received = 0; received < ProducerCount * EventCount; ) {
+		if (!queue.Pop(item)) {
+			queue.WaitItems(10);
+			continue;
+		}
+		int producer = -1, seq = -1;
+		SELF_CHECK(2 == std::sscanf(item.Data, "%d %d", &producer, &seq));
+		if (producer >= 0 && producer < ProducerCount) {
+			SELF_CHECK(seq == next_seq[producer] && (uint64_t)seq == item.Stamp);
+			next_seq[producer] = seq + 1;
+		}
+		if (0 == seq % 100) SELF_CHECK(std::strlen(item.Data) > LogEventQueue::ItemTextInlineLen);
+		item.Reset();
+		queue.SpaceFreed();
+		++received;
+	}
+	for (auto& producer : producers) producer.join();
+	SELF_CHECK(queue.IsEmpty());
+	LogQueueStats stats;
+	queue.GetStats(stats);
+	SELF_CHECK(stats.Pushed == (uint64_t)ProducerCount * EventCount);
+	SELF_CHECK(0 == stats.DroppedNewest && 0 == stats.DroppedOldest && 0 == stats.DroppedNoMemory);
+
+	// Overflow policies without the consumer: the newest / the oldest events are dropped
+	LogEventQueue queue_newest(Capacity, lopDropNewest), queue_oldest(Capacity, lopDropOldest);
+	for (int i = 0; i < Capacity + 10; ++i) {
+		std::string txt = std::to_string(i);
+		queue_newest.Push(LogTargetBase::etGeneral, llInfo, i, txt.c_str(), nullptr);
+		queue_oldest.Push(LogTargetBase::etGeneral, llInfo, i, txt.c_str(), nullptr);
+	}
+	queue_newest.GetStats(stats);
+	SELF_CHECK(stats.Pushed == (uint64_t)Capacity && 10 == stats.DroppedNewest);
+	for (int i = 0; i < Capacity; ++i) SELF_CHECK(queue_newest.Pop(item) && std::to_string(i) == item.Data);
+	queue_oldest.GetStats(stats);
+	SELF_CHECK(10 == stats.DroppedOldest);
+	for (int i = 10; i < Capacity + 10; ++i) SELF_CHECK(queue_oldest.Pop(item) && std::to_string(i) == item.Data);
+	SELF_CHECK(queue_newest.IsEmpty() && queue_oldest.IsEmpty());
+}
+
+// Async logger: the events of the threads are written in order, Flush waits for all of them
+static void SelfTest_LoggerAsync(const std::string& /*work_dir*/)
+{
+	const int ThreadCount = 4, EventCount = 5000;
+	std::atomic<int> received(0);
+	int next_seq[ThreadCount] = { }; // written by the async thread only
+	LoggerSettings settings;
+	settings.AsyncMode = true;
+	settings.AsyncQueueSize = 0x40;
+	LogTargetBase* target = new LogTargetTextFunc([&](LogTargetBase::EventType /*type*/, const char* txt) {
+		const char* msg = std::strstr(txt, "] ");
+		int thread = -1, seq = -1;
+		SELF_CHECK(msg && 2 == std::sscanf(msg + 2, "selftest %d %d", &thread, &seq));
+		if (thread >= 0 && thread < ThreadCount) {
+			SELF_CHECK(seq == next_seq[thread]);
+			next_seq[thread] = seq + 1;
+		}
+		++received;
+	});
+	Logger::InitSingleton(settings, &target, 1);
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < ThreadCount; ++thread) {
+		threads.emplace_back([thread]() {
+			for (int i = 0; i < EventCount; ++i) LOG_FMT(llInfo, "selftest %d %d", thread, i);
+		});
+	}
+	for (auto& thread : threads) thread.join();
+	Logger::GetInstance()->Flush();
+	SELF_CHECK(received == ThreadCount * EventCount);
+	LogQueueStats stats;
+	SELF_CHECK(((Logger*)Logger::GetInstance())->GetAsyncStats(stats));
+	SELF_CHECK(stats.Pushed == (uint64_t)ThreadCount * EventCount);
+	Logger::InitSingleton(LoggerSettings(), nullptr, 0); // deletes the target
+}
+
+// ****************************************** LogLimiters ******************************************
+
+// GCRA: the threads calling at once get the burst, then the rate (the calls of the elapsed time)
+static void SelfTest_LogLimiters(const std::string& /*work_dir*/)
+{
+	const unsigned Rate = 10, Burst = 5;
+	const int ThreadCount = 4, CallCount = 2000;
+	LogRateLimiter limiter(Rate, Burst);
+	std::atomic<int> allowed(0);
+	int64_t time_start = LogRateLimiter::Now();
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < ThreadCount; ++thread) {
+		threads.emplace_back([&limiter, &allowed]() {
+			for (int i = 0; i < CallCount; ++i)
+				if (limiter.Allow()) ++allowed;
+		});
+	}
+	for (auto& thread : threads) thread.join();
+	int64_t elapsed_ns = LogRateLimiter::Now() - time_start;
+	SELF_CHECK(allowed >= (int)Burst && allowed <= (int)(Burst + 1 + elapsed_ns * Rate / 1000000000));
+	SELF_CHECK(limiter.GetSuppressed() == (uint64_t)(ThreadCount * CallCount - allowed));
+	LogRateLimiter unlimited;
+	for (int i = 0; i < CallCount; ++i) SELF_CHECK(unlimited.Allow());
+
+	// Logger: per level rate limit and sampling, repeats suppression, call site limit
+	std::vector<std::string> written;
+	LogTargetBase* target = new LogTargetTextFunc([&written](LogTargetBase::EventType /*type*/, const char* txt) {
+		const char* msg = std::strstr(txt, "] ");
+		written.push_back(msg ? msg + 2 : txt);
+	}, llTrace);
+	LoggerSettings settings;
+	settings.LevelRateLimit[llError].Rate = Rate;
+	settings.LevelRateLimit[llError].Burst = Burst;
+	settings.LevelSampleRate[llWarn] = 4;
+	settings.SuppressRepeats = true;
+	Logger::InitSingleton(settings, &target, 1);
+	time_start = LogRateLimiter::Now();
+	for (int i = 0; i < 100; ++i) LOG_FMT(llError, "error %d", i);
+	elapsed_ns = LogRateLimiter::Now() - time_start;
+	int errors_written = (int)written.size();
+	SELF_CHECK(errors_written >= (int)Burst && errors_written <= (int)(Burst + 1 + elapsed_ns * Rate / 1000000000));
+	written.clear();
+	for (int i = 0; i < 100; ++i) LOG_FMT(llWarn, "warning %d", i);
+	SELF_CHECK(25 == written.size() && "warning 0" == written[0] && "warning 4" == written[1]);
+	written.clear();
+	for (int i = 0; i < 10; ++i) LOG_TXT(llInfo, "same");
+	LOG_TXT(llInfo, "other");
+	SELF_CHECK(3 == written.size() && "same" == written[0]);
+	SELF_CHECK(written.size() > 2 && "Last message repeated 9 times" == written[1] && "other" == written[2]);
+	LogSuppressStats stats;
+	((Logger*)Logger::GetInstance())->GetSuppressStats(stats);
+	SELF_CHECK(stats.RateLimited == (uint64_t)(100 - errors_written) && 75 == stats.Sampled && 9 == stats.Repeated);
+	written.clear();
+	for (int i = 0; i < 10; ++i) LOG_FMT_LIMIT(llInfo, 1, 2, "site %d", i);
+	const unsigned site_line = __LINE__ - 1;
+	SELF_CHECK(2 == written.size());
+	std::vector<LogSiteStats> site_stats;
+	LogSiteLimiter::GetStats(site_stats);
+	bool site_found = false;
+	for (const LogSiteStats& site : site_stats) {
+		if (site.Line != site_line || !std::strstr(site.File, "LisSelfTest")) continue;
+		site_found = true;
+		SELF_CHECK(8 == site.Suppressed);
+	}
+	SELF_CHECK(site_found);
+	Logger::InitSingleton(LoggerSettings(), nullptr, 0);
+}
+
+// ***************************************** LogStructured *****************************************
+
+// JSON string decoding (the escapes LogJsonEscape writes), false - invalid JSON string
+static bool SelfTest_JsonUnescape(const char* src, size_t src_len, std::string& dst)
+{
+	dst.clear();
+	for (const char* end = src + src_len; src < end; ++src) {
+		unsigned char chr = (unsigned char)*src;
+		if ('"' == chr || chr < 0x20) return false; // must be escaped
+		if ('\\' != chr) {
+			dst += (char)chr;
+			continue;
+		}
+		if (++src == end) return false;
+		switch (*src) {
+		case '"': case '\\': case '/': dst += *src; break;
+		case 'n': dst += '\n'; break;
+		case 'r': dst += '\r'; break;
+		case 't': dst += '\t'; break;
+		case 'b': dst += '\b'; break;
+		case 'f': dst += '\f'; break;
+		case 'u': {
+			unsigned code;
+			if (end - src < 5 || 1 != std::sscanf(src + 1, "%4x", &code) || code > 0xFF) return false;
+			dst += (char)code;
+			src += 4;
+			break;
+		}
+		default: return false;
+		}
+	}
+	return true;
+}
+
+// Escaping round trip of the random texts (all the byte values, the lengths around the SIMD block),
+// the fields serialization and the JSON lines target
+static void SelfTest_LogStructured(const std::string& work_dir)
+{
+	std::mt19937 random(12345);
+	std::string src, decoded;
+	std::vector<char> escaped;
+	for (int i = 0; i < 20000; ++i) {
+		src.resize(random() % 70);
+		unsigned special_rate = 1 + random() % 16; // the special chars are dense or rare
+		for (char& chr : src) chr = (char)((0 == random() % special_rate) ? random() % 0x100 : 'a' + random() % 26);
+		escaped.resize(src.size() * 6 + 1);
+		size_t escaped_len = LogJsonEscape(escaped.data(), src.data(), src.size()) - escaped.data();
+		SELF_CHECK(escaped_len <= src.size() * 6);
+		SELF_CHECK(SelfTest_JsonUnescape(escaped.data(), escaped_len, decoded) && decoded == src);
+		if (SelfTest_FailCount) break;
+	}
+
+	char json[0x200];
+	size_t json_len = LogFieldsToJson(json, sizeof(json), { { "int", -42 }, { "uint", 18446744073709551615ULL },
+		{ "dbl", 12.5 }, { "frac", 0.001 }, { "nan", std::nan("") }, { "bool", true },
+		{ "str", "a\"b\\c\n\x01" }, { "k\"ey", std::string("v") } });
+	const char* json_expected = "\"int\":-42,\"uint\":18446744073709551615,\"dbl\":12.5,\"frac\":0.001,"
+		"\"nan\":null,\"bool\":true,\"str\":\"a\\\"b\\\\c\\n\\u0001\",\"k\\\"ey\":\"v\"";
+	SELF_CHECK(json_len == std::strlen(json) && 0 == std::strcmp(json, json_expected));
+	for (int i = 0; i < 10000; ++i) {
+		double value = std::ldexp((double)random() / random.max() - 0.5, (int)(random() % 80) - 30);
+		json_len = LogFieldsToJson(json, sizeof(json), { { "v", value } });
+		double parsed = std::strtod(json + 4, nullptr);
+		SELF_CHECK(std::fabs(parsed - value) <= std::fabs(value) * 1e-14);
+		if (SelfTest_FailCount) break;
+	}
+	json_len = LogFieldsToJson(json, 64, { { "long", std::string(20, 'x') }, { "n", 1 } });
+	SELF_CHECK(0 == std::strcmp(json, "\"n\":1")); // the field which doesn't fit is skipped
+
+	const std::basic_string<FILE_PATH_CHAR> dir_path((FILE_PATH_CHAR*)LisStr::CStrConvert(work_dir.c_str()));
+	LogTargetJsonFile* target = new LogTargetJsonFile(dir_path.c_str(), FILE_PATH_TEXT("selftest_json_"), llInfo);
+	std::basic_string<FILE_PATH_CHAR> file_path = target->GetFilePath(std::chrono::system_clock::now());
+	LisFileSys::FileDelete(file_path.c_str());
+	LogTargetBase* targets[] = { target };
+	Logger::InitSingleton(LoggerSettings(), targets, 1);
+	LOG_STRUCT(llInfo, "say \"hi\"", { "user", "tab\there" }, { "ms", 2.25 });
+	Logger::InitSingleton(LoggerSettings(), nullptr, 0); // closes the file
+	std::ifstream file_stm(file_path);
+	std::string line;
+	SELF_CHECK(std::getline(file_stm, line));
+	const std::string line_end = "\"level\":\"inf\",\"msg\":\"say \\\"hi\\\"\",\"user\":\"tab\\there\",\"ms\":2.25}";
+	SELF_CHECK(0 == line.compare(0, 9, "{\"time\":\"") && line.size() > line_end.size()
+		&& 0 == line.compare(line.size() - line_end.size(), line_end.size(), line_end));
+	file_stm.close();
+	if (0 == SelfTest_FailCount) LisFileSys::FileDelete(file_path.c_str());
+}
+
+// ******************************************* BinLogger *******************************************
+
+static long long SelfTest_FileSize(const std::string& path)
+{
+	std::ifstream file_stm(path, std::ios_base::in | std::ios::binary | std::ios_base::ate);
+	return file_stm ? (long long)file_stm.tellg() : -1;
+}
+
+// The threads' events decoded by BinLogReader are the same texts as printf makes, in order per thread;
+// the reopened file is appended, the torn last record is dropped
+static void SelfTest_BinLog(const std::string& work_dir)
+{
+	const int ThreadCount = 3, EventCount = 1000;
+	const std::string path = work_dir + "selftest.bin";
+	const std::basic_string<FILE_PATH_CHAR> path_str((FILE_PATH_CHAR*)LisStr::CStrConvert(path.c_str()));
+	const FILE_PATH_CHAR* file_path = path_str.c_str();
+	LisFileSys::FileDelete(file_path);
+	std::vector<std::string> expected[ThreadCount + 1];
+	auto time_start = std::chrono::system_clock::now();
+	{
+		BinLogger logger(file_path, llInfo, 0);
+		SELF_CHECK(0 == logger.GetStatus());
+		std::vector<std::thread> threads;
+		for (int thread = 0; thread < ThreadCount; ++thread) {
+			threads.emplace_back([&logger, &expected, thread]() {
+				const std::string name(thread * 150, 'n'); // up to the long strings
+				char txt[1024];
+				for (int i = 0; i < EventCount; ++i) {
+					LOG_BIN(logger, llInfo, "%d %u %lld %s|%.3f %-6s|%x %c %*d %%", thread, (unsigned)i,
+						-1000000007LL * i, name.c_str(), i / 8.0, "ab", i, 'a' + i % 26, 5, -i);
+					std::snprintf(txt, sizeof(txt), "%d %u %lld %s|%.3f %-6s|%x %c %*d %%", thread, (unsigned)i,
+						-1000000007LL * i, name.c_str(), i / 8.0, "ab", i, 'a' + i % 26, 5, -i);
+					expected[thread].push_back(txt);
+					LOG_BIN(logger, llDebug, "%d filtered", thread);
+				}
+			});
+		}
+		for (auto& thread : threads) thread.join();
+	}
+	{
+		BinLogger logger(file_path, llTrace, 0);
+		LOG_BIN(logger, llError, "%d appended %s", ThreadCount, "text");
+		expected[ThreadCount].push_back(std::to_string(ThreadCount) + " appended text");
+	}
+	// the process killed while writing the record: the next logger drops it
+	long long file_size = SelfTest_FileSize(path);
+	SELF_CHECK(file_size > 0 && LisFileSys::FileTruncate(file_path, file_size - 3));
+	{
+		BinLogger logger(file_path, llTrace, 0);
+		SELF_CHECK(0 == logger.GetStatus());
+		LOG_BIN(logger, llError, "%d after torn", ThreadCount);
+		expected[ThreadCount].back() = std::to_string(ThreadCount) + " after torn";
+	}
+	auto time_end = std::chrono::system_clock::now();
+
+	BinLogReader reader(file_path);
+	SELF_CHECK(0 == reader.GetStatus());
+	size_t next[ThreadCount + 1] = { };
+	LogLevel lvl;
+	std::chrono::system_clock::time_point time;
+	std::string text;
+	while (reader.ReadEvent(lvl, time, text)) {
+		int thread = std::atoi(text.c_str());
+		SELF_CHECK(thread >= 0 && thread <= ThreadCount);
+		if (thread < 0 || thread > ThreadCount || next[thread] >= expected[thread].size()) continue;
+		SELF_CHECK(text == expected[thread][next[thread]++]);
+		SELF_CHECK(lvl == (thread < ThreadCount ? llInfo : llError));
+		SELF_CHECK(time >= time_start - std::chrono::milliseconds(100) && time <= time_end);
+	}
+	SELF_CHECK(0 == reader.GetStatus());
+	for (int thread = 0; thread <= ThreadCount; ++thread) SELF_CHECK(next[thread] == expected[thread].size());
+	if (0 == SelfTest_FailCount) LisFileSys::FileDelete(file_path);
+}
+
+// ***************************************** LogFileReader *****************************************
+
+// The time range and level queries of the generated log file (with and without the side index)
+// return the same events as the brute force filter
+static void SelfTest_LogFileReader(const std::string& work_dir)
+{
+	static const char* level_tags[llNone] = { "trc", "dbg", "inf", "Wrn", "ERR", "FLT" };
+	const int EventCount = 20000, EventStepMs = 731;
+	struct Event { uint64_t TimeKey; LogLevel Level; std::string Text; };
+	std::vector<Event> events;
+	std::mt19937 random(54321);
+	const std::string path = work_dir + "selftest_query.log", index_path = path + ".idx";
+	const std::basic_string<FILE_PATH_CHAR> file_path((FILE_PATH_CHAR*)LisStr::CStrConvert(path.c_str()));
+	const std::basic_string<FILE_PATH_CHAR> index_file_path((FILE_PATH_CHAR*)LisStr::CStrConvert(index_path.c_str()));
+	{
+		std::ofstream file_stm(path, std::ios_base::out | std::ios::binary | std::ios_base::trunc);
+		char txt[128];
+		for (int i = 0; i < EventCount; ++i) {
+			unsigned ms = i * EventStepMs;
+			unsigned hour = ms / 3600000, min = ms / 60000 % 60, sec = ms / 1000 % 60;
+			Event evt = { 20250301000000000ULL + hour * 10000000ULL + min * 100000 + sec * 1000 + ms % 1000,
+				(LogLevel)(random() % llNone), std::string() };
+			std::snprintf(txt, sizeof(txt), "2025-03-01 %02u:%02u:%02u.%03u [%s] event %d\n",
+				hour, min, sec, ms % 1000, level_tags[evt.Level], i);
+			evt.Text = txt;
+			if (0 == random() % 10) evt.Text += "\t0000: 01 02 03\n\t0003: 04\n"; // continuation lines
+			file_stm << evt.Text;
+			events.push_back(evt);
+		}
+	}
+	SELF_CHECK(20250301015959999ULL == LogTimeKeyParse("2025-03-01 01", true));
+	SELF_CHECK(20250301010000000ULL == LogTimeKeyParse("2025-03-01 01", false));
+
+	for (int pass = 0; pass < 3; ++pass) { // without the index, built index, loaded index
+		LogFileReader reader;
+		SELF_CHECK(reader.Open(file_path.c_str()));
+		if (1 == pass) {
+			SELF_CHECK(reader.BuildIndex(0x1000) > 0);
+			SELF_CHECK(reader.SaveIndex(index_file_path.c_str()));
+		}
+		if (2 == pass) SELF_CHECK(reader.LoadIndex(index_file_path.c_str()) && reader.GetIndexSize() > 0);
+		for (int query = 0; query < 200; ++query) {
+			uint64_t from_key = events[random() % EventCount].TimeKey + random() % 3 - 1;
+			uint64_t to_key = (0 == query % 10) ? UINT64_MAX : events[random() % EventCount].TimeKey + random() % 3 - 1;
+			if (from_key > to_key) std::swap(from_key, to_key);
+			unsigned level_mask = (0 == query % 4) ? LogLvlMaskAll : 1 + random() % LogLvlMaskAll;
+			size_t next = 0;
+			long long count = reader.Query(from_key, to_key, level_mask, [&](LogLevel lvl, const char* txt, size_t len) {
+				while (next < events.size() && !(events[next].TimeKey >= from_key && events[next].TimeKey <= to_key
+					&& 0 != (level_mask & LogLvlMask(events[next].Level)))) ++next;
+				SELF_CHECK(next < events.size());
+				if (next >= events.size()) return false;
+				SELF_CHECK(lvl == events[next].Level && events[next].Text.compare(0, std::string::npos, txt, len) == 0);
+				++next;
+				return 0 == SelfTest_FailCount;
+			});
+			long long expected = 0;
+			for (const Event& evt : events) {
+				if (evt.TimeKey >= from_key && evt.TimeKey <= to_key && 0 != (level_mask & LogLvlMask(evt.Level)))
+					++expected;
+			}
+			SELF_CHECK(count == expected);
+			if (SelfTest_FailCount) break;
+		}
+		size_t pos = reader.FindTime(events[EventCount / 2].TimeKey);
+		SELF_CHECK(pos < reader.GetSize() && 0 == events[EventCount / 2].Text.compare(0, std::string::npos,
+			reader.GetData() + pos, std::min(events[EventCount / 2].Text.size(), reader.GetSize() - pos)));
+		SELF_CHECK(reader.GetSize() == reader.FindTime(events.back().TimeKey + 1));
+	}
+	if (0 == SelfTest_FailCount) {
+		LisFileSys::FileDelete(file_path.c_str());
+		LisFileSys::FileDelete(index_file_path.c_str());
+	}
+}
+
+// ****************************************** SnapshotPtr ******************************************
+
+// The snapshot data: all the values are equal, the deleted one is poisoned
+struct SelfTestSnapshot
+{
+	static std::atomic<int> LiveCount;
+	std::vector<int> Values;
+	SelfTestSnapshot() : Values(64, 0) { ++LiveCount; }
+	SelfTestSnapshot(const SelfTestSnapshot& src) : Values(src.Values) { ++LiveCount; }
+	~SelfTestSnapshot() {
+		for (int& value : Values) value = -1;
+		--LiveCount;
+	}
+};
+std::atomic<int> SelfTestSnapshot::LiveCount(0);
+
+// The readers see the consistent snapshots (not changed or deleted while read, never older ones)
+// while the writers replace them; the replaced snapshots are all deleted
+static void SelfTest_SnapshotPtr(const std::string& /*work_dir*/)
+{
+	const int ReaderCount = 4, WriterCount = 2, UpdateCount = 5000;
+	{
+		LisThread::SnapshotPtr<SelfTestSnapshot> snapshot;
+		std::atomic<bool> stop_flag(false);
+		std::vector<std::thread> threads;
+		for (int reader = 0; reader < ReaderCount; ++reader) {
+			threads.emplace_back([&snapshot, &stop_flag]() {
+				int last_value = 0;
+				while (!stop_flag.load() && !SelfTest_FailCount) {
+					{
+						LisThread::SnapshotPtr<SelfTestSnapshot>::ReadGuard data(snapshot);
+						int value = data->Values.front();
+						for (int item : data->Values) SELF_CHECK(item == value);
+						SELF_CHECK(value >= last_value);
+						last_value = value;
+					}
+					std::this_thread::yield(); // the writers waiting for the readers progress on a single core too
+				}
+			});
+		}
+		std::vector<std::thread> writers;
+		for (int writer = 0; writer < WriterCount; ++writer) {
+			writers.emplace_back([&snapshot, writer]() {
+				for (int i = 0; i < UpdateCount; ++i) {
+					SELF_CHECK(snapshot.Update([](SelfTestSnapshot& data) {
+						for (int& value : data.Values) ++value;
+						return true;
+					}, 0 == (i + writer) % 2)); // waiting for the readers or not
+				}
+			});
+		}
+		for (auto& writer : writers) writer.join();
+		stop_flag = true;
+		for (auto& thread : threads) thread.join();
+		SELF_CHECK(!snapshot.Update([](SelfTestSnapshot&) { return false; }));
+		LisThread::SnapshotPtr<SelfTestSnapshot>::ReadGuard data(snapshot);
+		SELF_CHECK(WriterCount * UpdateCount == data->Values.back());
+	}
+	SELF_CHECK(0 == SelfTestSnapshot::LiveCount);
+	{
+		LisThread::SnapshotPtr<SelfTestSnapshot> snapshot;
+		for (int i = 0; i < 10; ++i) snapshot.Update([](SelfTestSnapshot&) { return true; }, false);
+		SELF_CHECK(snapshot.Reclaim(true) && 1 == SelfTestSnapshot::LiveCount); // no readers: all deleted
+	}
+	SELF_CHECK(0 == SelfTestSnapshot::LiveCount);
+}
+
+// ************************************** EventDispatcherBase **************************************
+
+template <typename TEventType>
+class SelfTestDispatcher : public EventDispatcherBase<SelfTestDispatcher<TEventType>, TEventType, int>
+{
+	typedef EventDispatcherBase<SelfTestDispatcher<TEventType>, TEventType, int> Base;
+public:
+	using Base::RaiseEvent;
+	using Base::PostEvent;
+	using Base::EventQueueStart;
+	using Base::EventQueueStop;
+	using Base::EventQueueDrain;
+};
+
+// The handlers changed while the event is raised (also by the nested raise): the unsubscribed ones
+// aren't called anymore, the new ones are called from the next raise, in the subscription order
+template <typename TEventType>
+static void SelfTest_DispatchDeferred(TEventType type, TEventType nested_type)
+{
+	typedef SelfTestDispatcher<TEventType> Dispatcher;
+	typedef typename Dispatcher::EventInfo EventInfo;
+	typedef typename Dispatcher::EventSubscriptionId SubscriptionId;
+	Dispatcher disp;
+	std::string calls;
+	auto handler = [&calls](const char* name) {
+		return typename Dispatcher::EventHandler([&calls, name](const Dispatcher*, const EventInfo& evt_info) {
+			calls += name;
+			return (4 == evt_info.data) ? -1 : 0; // 4 - stop the event
+		});
+	};
+	SubscriptionId id2 = 0, id4 = 0, id6 = 0;
+	SubscriptionId id1 = disp.EventSubscribe(type, [&](const Dispatcher*, const EventInfo& evt_info) {
+		calls += "1";
+		switch (evt_info.data) {
+		case 1: // unsubscribe the next handler, subscribe the new one
+			SELF_CHECK(disp.EventUnsubscribe(id2));
+			id4 = disp.EventSubscribe(type, handler("4"));
+			break;
+		case 2: disp.RaiseEvent(nested_type, 0); break;
+		case 3: // the deferred subscription is cancelled
+			id6 = disp.EventSubscribe(type, handler("6"));
+			SELF_CHECK(disp.EventUnsubscribe(id6) && !disp.EventUnsubscribe(id6));
+			break;
+		case 5: SELF_CHECK(disp.EventUnsubscribe(type)); break;
+		}
+		return 0;
+	});
+	id2 = disp.EventSubscribe(type, handler("2"));
+	disp.EventSubscribe(type, handler("3"));
+	disp.EventSubscribe(nested_type, [&](const Dispatcher*, const EventInfo&) {
+		calls += "n";
+		disp.EventSubscribe(type, handler("5"));
+		for (int i = 0; i < 16; ++i) disp.EventSubscribe(type, handler("")); // the handlers array would grow
+		return 0;
+	});
+	SELF_CHECK(id1 && id2 && id1 != id2);
+	auto raise = [&](int data, const char* expected) {
+		calls.clear();
+		int result = disp.RaiseEvent(type, data);
+		SELF_CHECK(calls == expected && result == ((4 == data) ? -1 : 0));
+	};
+	raise(0, "123");
+	raise(1, "13");
+	SELF_CHECK(id4 && !disp.EventUnsubscribe(id2));
+	raise(0, "134");
+	raise(2, "1n34");
+	raise(0, "1345");
+	raise(3, "1345");
+	raise(0, "1345");
+	raise(4, "13");
+	SubscriptionId id7 = disp.EventSubscribe(type, handler("7")); // may reuse the slot of id2 or id6
+	SELF_CHECK(!disp.EventUnsubscribe(id2) && !disp.EventUnsubscribe(id6));
+	raise(0, "13457");
+	SELF_CHECK(disp.EventUnsubscribe(id4));
+	raise(0, "1357");
+	raise(5, "1");
+	raise(0, "");
+	SELF_CHECK(!disp.EventUnsubscribe(id1) && !disp.EventUnsubscribe(id7));
+	SubscriptionId id8 = disp.EventSubscribe(type, handler("8"));
+	raise(0, "8");
+	SELF_CHECK(disp.EventUnsubscribe(id8));
+}
+
+static void SelfTest_EventDispatcher(const std::string& /*work_dir*/)
+{
+	SelfTest_DispatchDeferred<int>(10, 20);
+	SelfTest_DispatchDeferred<SelfTestEvent>(steSecond, steThird);
+}
+
+// ************************************** EventDispatchQueue ***************************************
+
+// Queued dispatch: the events posted by the threads are dispatched once, in order per thread, Flush waits
+// for the events posted before it; coalescing, the overflow policies, the reentrant posts and stops
+static void SelfTest_EventDispatchQueue(const std::string& /*work_dir*/)
+{
+	typedef SelfTestDispatcher<int> Dispatcher;
+	typedef Dispatcher::EventInfo EventInfo;
+	const int PostThreads = 4, PostCount = 5000;
+	LisThread::ThreadTaskMgr task_mgr;
+	for (int pass = 0; pass < 2; ++pass) { // own worker thread, ThreadTaskMgr task
+		Dispatcher disp;
+		std::atomic<int> received[PostThreads];
+		for (int type = 0; type < PostThreads; ++type) {
+			received[type] = 0;
+			disp.EventSubscribe(type, [&received](const Dispatcher*, const EventInfo& evt_info) {
+				SELF_CHECK(evt_info.data == received[evt_info.type]);
+				++received[evt_info.type];
+				return 0;
+			});
+		}
+		EventQueueSettings settings;
+		settings.Capacity = 16;
+		SELF_CHECK(disp.EventQueueStart(settings, (1 == pass) ? &task_mgr : nullptr));
+		std::vector<std::thread> threads;
+		for (int thread = 0; thread < PostThreads; ++thread) {
+			threads.emplace_back([&disp, &received, thread]() {
+				for (int i = 0; i < PostCount; ++i) {
+					SELF_CHECK(disp.PostEvent(thread, i));
+					if (0 == i % 500) SELF_CHECK(disp.EventQueueFlush() && received[thread] == i + 1);
+				}
+			});
+		}
+		for (auto& thread : threads) thread.join();
+		SELF_CHECK(disp.EventQueueFlush());
+		for (int type = 0; type < PostThreads; ++type) SELF_CHECK(PostCount == received[type]);
+		EventQueueStats stats = EventQueueStats();
+		SELF_CHECK(disp.GetEventQueueStats(stats));
+		SELF_CHECK(stats.Posted == (uint64_t)PostThreads * PostCount && stats.Dispatched == stats.Posted);
+		SELF_CHECK(stats.MaxDepth <= settings.Capacity);
+		SELF_CHECK(disp.EventQueueStop());
+	}
+
+	// Manual drain: coalescing, dropping the oldest / the newest events, the handler posting to the full queue
+	std::string calls;
+	auto record = [&calls](const Dispatcher*, const EventInfo& evt_info) {
+		calls += std::to_string(evt_info.type) + ":" + std::to_string(evt_info.data) + " ";
+		return 0;
+	};
+	EventQueueSettings settings;
+	settings.ManualDrain = true;
+	EventQueueStats stats = EventQueueStats();
+	{
+		Dispatcher disp;
+		disp.EventSubscribe(1, record);
+		disp.EventSubscribe(2, record);
+		settings.Coalesce = true;
+		disp.EventQueueStart(settings);
+		for (int data : { 1, 2, 3 }) disp.PostEvent(1, data);
+		disp.PostEvent(2, 10);
+		disp.PostEvent(1, 4);
+		SELF_CHECK(2 == disp.EventQueueDrain() && "1:4 2:10 " == calls);
+		disp.GetEventQueueStats(stats);
+		SELF_CHECK(3 == stats.Coalesced && 2 == stats.Posted);
+		calls.clear();
+		disp.PostEvent(1, 5); // the dispatched event isn't coalesced
+		SELF_CHECK(disp.EventQueueFlush() && "1:5 " == calls);
+		disp.EventQueueStop();
+	}
+	for (EventQueueOverflow overflow : { eqoDropOldest, eqoDropNewest }) {
+		Dispatcher disp;
+		disp.EventSubscribe(1, record);
+		settings.Coalesce = false;
+		settings.Capacity = 4;
+		settings.Overflow = overflow;
+		disp.EventQueueStart(settings);
+		calls.clear();
+		for (int data = 0; data < 10; ++data) SELF_CHECK(disp.PostEvent(1, data) == (eqoDropOldest == overflow || data < 4));
+		disp.EventQueueDrain();
+		disp.GetEventQueueStats(stats);
+		if (eqoDropOldest == overflow) SELF_CHECK("1:6 1:7 1:8 1:9 " == calls && 6 == stats.DroppedOldest);
+		else SELF_CHECK("1:0 1:1 1:2 1:3 " == calls && 6 == stats.DroppedNewest);
+		disp.EventQueueStop();
+	}
+	{
+		Dispatcher disp;
+		settings.Capacity = 2;
+		settings.Overflow = eqoBlock;
+		disp.EventSubscribe(2, record);
+		disp.EventSubscribe(1, [&disp](const Dispatcher*, const EventInfo&) {
+			SELF_CHECK(disp.PostEvent(2, 1) && disp.PostEvent(2, 2));
+			SELF_CHECK(!disp.PostEvent(2, 3)); // would wait for its own drain
+			SELF_CHECK(!disp.EventQueueFlush());
+			return 0;
+		});
+		disp.EventQueueStart(settings);
+		calls.clear();
+		disp.PostEvent(1, 0);
+		SELF_CHECK(disp.EventQueueFlush() && "2:1 2:2 " == calls);
+		disp.GetEventQueueStats(stats);
+		SELF_CHECK(1 == stats.DroppedReentrant);
+		disp.EventQueueStop();
+	}
+
+	// The handler stops the queue: only requested, the posts are rejected, the owner stops it
+	{
+		Dispatcher disp;
+		std::atomic<bool> stop_requested(false);
+		disp.EventSubscribe(1, [&](const Dispatcher*, const EventInfo&) {
+			SELF_CHECK(!disp.EventQueueStop());
+			SELF_CHECK(!disp.PostEvent(1, 1));
+			stop_requested = true;
+			return 0;
+		});
+		settings = EventQueueSettings();
+		disp.EventQueueStart(settings);
+		disp.PostEvent(1, 0);
+		while (!stop_requested) std::this_thread::yield();
+		SELF_CHECK(!disp.PostEvent(1, 2));
+		SELF_CHECK(disp.EventQueueStop());
+	}
+}
+
+// *********************************** EventDispatcherConcurrent ***********************************
+
+class SelfTestConcurrentDispatcher : public EventDispatcherConcurrent<SelfTestConcurrentDispatcher, int, int>
+{
+public:
+	using EventDispatcherConcurrent::RaiseEvent;
+};
+
+// Handler state: counts the live copies, the destroyed one is poisoned
+struct SelfTestHandlerState
+{
+	static std::atomic<int> LiveCount;
+	static const unsigned MagicValue = 0x5E1F7E57;
+	unsigned Magic;
+	SelfTestHandlerState() : Magic(MagicValue) { ++LiveCount; }
+	SelfTestHandlerState(const SelfTestHandlerState& src) : Magic(src.Magic) { ++LiveCount; }
+	~SelfTestHandlerState() {
+		Magic = 0;
+		--LiveCount;
+	}
+};
+std::atomic<int> SelfTestHandlerState::LiveCount(0);
+
+// The threads raise the event while the others subscribe and unsubscribe the handlers: every raise calls
+// the handler subscribed for the whole time once, no destroyed handler is called; the unsubscribed
+// handlers are all destroyed after the raises
+static void SelfTest_EventDispatcherConcurrent(const std::string& /*work_dir*/)
+{
+	typedef SelfTestConcurrentDispatcher Dispatcher;
+	const int RaiseThreads = 3, RaiseCount = 20000, ChurnThreads = 2, ChurnCount = 2000;
+	{
+		Dispatcher disp;
+		std::atomic<int> raise_calls(0);
+		Dispatcher::EventSubscriptionId persistent_id = disp.EventSubscribe(1,
+			[&raise_calls](const Dispatcher*, const Dispatcher::EventInfo&) { ++raise_calls; return 0; });
+		std::vector<std::thread> threads;
+		for (int thread = 0; thread < RaiseThreads; ++thread) {
+			threads.emplace_back([&disp]() {
+				for (int i = 0; i < RaiseCount; ++i) disp.RaiseEvent(1, i);
+			});
+		}
+		for (int thread = 0; thread < ChurnThreads; ++thread) {
+			threads.emplace_back([&disp]() {
+				SelfTestHandlerState state;
+				for (int i = 0; i < ChurnCount; ++i) {
+					Dispatcher::EventSubscriptionId id = disp.EventSubscribe(1 + i % 2,
+						[state](const Dispatcher*, const Dispatcher::EventInfo&) {
+							SELF_CHECK(SelfTestHandlerState::MagicValue == state.Magic);
+							return 0;
+						});
+					SELF_CHECK(0 != id);
+					if (0 == i % 100) SELF_CHECK(disp.RaiseEvent(2, i) >= 0); // the handlers change from the raise
+					SELF_CHECK(disp.EventUnsubscribe(id) && !disp.EventUnsubscribe(id));
+				}
+			});
+		}
+		for (auto& thread : threads) thread.join();
+		SELF_CHECK(RaiseThreads * RaiseCount == raise_calls);
+		SELF_CHECK(disp.EventReclaim(true) && 0 == SelfTestHandlerState::LiveCount);
+		SELF_CHECK(disp.EventUnsubscribe(persistent_id));
+		raise_calls = 0;
+		disp.RaiseEvent(1, 0);
+		SELF_CHECK(0 == raise_calls);
+
+		// the handler unsubscribing itself: the raise in progress completes, the next one doesn't call it
+		std::string calls;
+		Dispatcher::EventSubscriptionId self_id = 0;
+		self_id = disp.EventSubscribe(3, [&](const Dispatcher*, const Dispatcher::EventInfo&) {
+			calls += "1";
+			SELF_CHECK(disp.EventUnsubscribe(self_id));
+			return 0;
+		});
+		disp.EventSubscribe(3, [&calls](const Dispatcher*, const Dispatcher::EventInfo&) { calls += "2"; return 0; });
+		disp.RaiseEvent(3, 0);
+		disp.RaiseEvent(3, 0);
+		SELF_CHECK("122" == calls);
+	}
+	SELF_CHECK(0 == SelfTestHandlerState::LiveCount);
+}
+
+// ******************************************* Delegate ********************************************
+
+// Callable counting its live instances and copies, PadSize selects the inline or the heap storage
+template <size_t PadSize>
+struct SelfTestFunctor
+{
+	static int LiveCount, CopyCount;
+	int Sum;
+	char Pad[PadSize];
+	SelfTestFunctor() : Sum(0) { ++LiveCount; }
+	SelfTestFunctor(const SelfTestFunctor& src) : Sum(src.Sum) { ++LiveCount; ++CopyCount; }
+	SelfTestFunctor(SelfTestFunctor&& src) noexcept : Sum(src.Sum) { ++LiveCount; }
+	~SelfTestFunctor() { --LiveCount; }
+	int operator()(int add) { return Sum += add; }
+};
+template <size_t PadSize> int SelfTestFunctor<PadSize>::LiveCount = 0;
+template <size_t PadSize> int SelfTestFunctor<PadSize>::CopyCount = 0;
+
+// The copies have own state, the move doesn't copy and empties the source, every instance is destroyed once
+template <size_t PadSize>
+static void SelfTest_DelegateOwnership()
+{
+	typedef Delegate<int(int)> Func;
+	typedef SelfTestFunctor<PadSize> Functor;
+	{
+		Func func1{ Functor() };
+		SELF_CHECK(func1 && 1 == func1(1));
+		Func func2(func1);
+		SELF_CHECK(2 == func2(1) && 2 == func1(1));
+		int copy_count = Functor::CopyCount;
+		Func func3(std::move(func2));
+		SELF_CHECK(!func2 && 3 == func3(1) && copy_count == Functor::CopyCount);
+		func2 = func3;
+		SELF_CHECK(4 == func2(1) && 4 == func3(1));
+		Func& func3_ref = func3;
+		func3 = func3_ref;
+		SELF_CHECK(5 == func3(1));
+		func1.swap(func3);
+		SELF_CHECK(6 == func1(1) && 3 == func3(1));
+		SELF_CHECK(3 == Functor::LiveCount);
+		func2 = nullptr;
+		func3 = [](int add) { return -add; };
+		SELF_CHECK(!func2 && -1 == func3(1) && 1 == Functor::LiveCount);
+		func2 = std::move(func1);
+		SELF_CHECK(!func1 && 7 == func2(1) && 1 == Functor::LiveCount);
+	}
+	SELF_CHECK(0 == Functor::LiveCount);
+}
+
+struct SelfTestDelegateTarget
+{
+	int Base;
+	int Add(int value) { return Base += value; }
+	int Get(int value) const { return Base * value; }
+};
+
+static void SelfTest_Delegate(const std::string& /*work_dir*/)
+{
+	typedef Delegate<int(int)> Func;
+	Func empty;
+	int (*null_func)(int) = nullptr;
+	Func from_null(null_func), from_empty_function(std::function<int(int)>{});
+	SELF_CHECK(!empty && empty == nullptr && nullptr == empty && !from_null && !from_empty_function);
+	bool is_thrown = false;
+	try {
+		empty(1);
+	} catch (const std::bad_function_call&) {
+		is_thrown = true;
+	}
+	SELF_CHECK(is_thrown);
+	Func copy_of_empty(empty);
+	SELF_CHECK(!copy_of_empty);
+
+	int factor = 3, offset = 4;
+	Func trivial = [factor, offset](int value) { return factor * value + offset; };
+	Func trivial_copy = trivial;
+	SELF_CHECK(10 == trivial(2) && 13 == trivial_copy(3));
+	Func from_function(std::function<int(int)>([](int value) { return value * value; }));
+	SELF_CHECK(from_function && 16 == from_function(4));
+
+	SelfTestDelegateTarget target = { 10 };
+	Func method(&target, &SelfTestDelegateTarget::Add);
+	Func const_method((const SelfTestDelegateTarget*)&target, &SelfTestDelegateTarget::Get);
+	SELF_CHECK(15 == method(5) && 15 == target.Base && 30 == const_method(2));
+
+	Delegate<void(int&)> increment = [](int& value) { ++value; };
+	int value = 0;
+	increment(value);
+	SELF_CHECK(1 == value);
+	std::string captured(100, 's'); // not trivially copyable, allocates
+	Delegate<size_t()> string_size = [captured]() { return captured.size(); };
+	Delegate<size_t()> string_size_copy = string_size;
+	string_size = nullptr;
+	SELF_CHECK(100 == string_size_copy());
+
+	SelfTest_DelegateOwnership<4>(); // inline
+	SelfTest_DelegateOwnership<64>(); // heap
+}
+
+// ********************************************* main **********************************************
+
+struct SelfTest {
+	const char* Name;
+	void (*Proc)(const std::string& work_dir); // work_dir ends with the path separator
+};
+
+static const SelfTest SelfTests[] = {
+	{ "LogEventQueue", SelfTest_LogEventQueue },
+	{ "LoggerAsync", SelfTest_LoggerAsync },
+	{ "BinLog", SelfTest_BinLog },
+	{ "LogLimiters", SelfTest_LogLimiters },
+	{ "LogStructured", SelfTest_LogStructured },
+	{ "LogFileReader", SelfTest_LogFileReader },
+	{ "SnapshotPtr", SelfTest_SnapshotPtr },
+	{ "EventDispatcher", SelfTest_EventDispatcher },
+	{ "EventDispatcherConcurrent", SelfTest_EventDispatcherConcurrent },
+	{ "EventDispatchQueue", SelfTest_EventDispatchQueue },
+	{ "Delegate", SelfTest_Delegate },
+};
+
+int main(int argc, char* argv[])
+{
+	std::string work_dir = "LisSelfTest";
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; ++i) {
+		if (0 == std::strcmp(argv[i], "-d") && i + 1 < argc && argv[i + 1][0]) work_dir = argv[++i];
+		else if ('-' == argv[i][0]) {
+			std::fprintf(stderr, "Usage: %s [-d <work directory>] [<test name> ...]\n", argv[0]);
+			return -1;
+		}
+		else names.push_back(argv[i]);
+	}
+	if (FILE_PATH_SEPARATOR_CHR != work_dir.back()) work_dir += FILE_PATH_SEPARATOR_CHR;
+	if (!LisFileSys::DirExistCheck(nullptr, (FILE_PATH_CHAR*)LisStr::CStrConvert(work_dir.c_str()), true)) {
+		std::fprintf(stderr, "Can't create work directory: %s\n", work_dir.c_str());
+		return -1;
+	}
+
+	int run_count = 0, fail_count = 0;
+	for (const SelfTest& test : SelfTests) {
+		bool selected = names.empty();
+		for (const std::string& name : names) selected = selected || (name == test.Name);
+		if (!selected) continue;
+		std::printf("%s\n", test.Name);
+		std::fflush(stdout);
+		SelfTest_FailCount = 0;
+		test.Proc(work_dir);
+		++run_count;
+		if (SelfTest_FailCount) ++fail_count;
+	}
+	if (0 == fail_count) LisFileSys::DirDelete((FILE_PATH_CHAR*)LisStr::CStrConvert(work_dir.c_str()));
+	std::printf("%d tests run, %d failed\n", run_count, fail_count);
+	return fail_count;
+}
@@ -0,0 +1,38 @@
+// ****** Binary log decoder tool. (c) 2025 LISV ******
+// Usage: LogBinDecode <binary log file> [<output directory> <file name prefix>]
+// Prints the events as text to stdout, or writes them to the text log files (LogTargetTextFile).
+#include <cstdio>
+#include "../LisCommon/LogBinary.h"
+#include "../LisCommon/StrUtils.h"
+
+using namespace LisLog;
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2 && argc != 4) {
+		std::fprintf(stderr, "Usage: %s <binary log file> [<output directory> <file name prefix>]\n", argv[0]);
+		return 1;
+	}
+	BinLogReader reader((FILE_PATH_CHAR*)LisStr::CStrConvert(argv[1]));
+	if (0 != reader.GetStatus()) {
+		std::fprintf(stderr, "Can't read binary log file: %s\n", argv[1]);
+		return 2;
+	}
+	std::unique_ptr<LogTargetBase> target;
+	if (argc == 4)
+		target.reset(new LogTargetTextFile((FILE_PATH_CHAR*)LisStr::CStrConvert(argv[2]),
+			(FILE_PATH_CHAR*)LisStr::CStrConvert(argv[3]), llTrace, lfpBytes, LogFileBufferSize));
+	else
+		target.reset(new LogTargetTextFunc(
+			[](LogTargetBase::EventType /*type*/, const char* txt) { std::fputs(txt, stdout); }, llTrace, true));
+	if (0 != target->GetStatus()) {
+		std::fprintf(stderr, "Can't write the output: %s\n", argv[2]);
+		return 3;
+	}
+	long long count = reader.Decode(*target);
+	if (reader.GetStatus() < 0) {
+		std::fprintf(stderr, "Data error after %lld events\n", count);
+		return 4;
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+// ****** Text log file query tool. (c) 2025 LISV ******
+// Usage: LogQuery <log file> [-from <time>] [-to <time>] [-l <levels>] [-c] [-i [<step KiB>]]
+// Prints the events of the text log file (LogTargetTextFile) in the time range to stdout;
+// time - "YYYY-MM-DD[ HH[:MM[:SS[.mmm]]]]" (-to includes the whole given period),
+// levels - comma separated level tags (trc,dbg,inf,wrn,err,flt), -c - print the events count and
+// the query time only, -i - build the side index file <log file>.idx (used by the next queries
+// while the log file is only appended).
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "../LisCommon/LogFileReader.h"
+#include "../LisCommon/StrUtils.h"
+
+using namespace LisLog;
+
+// "inf,ERR" -> the levels mask, 0 - unknown tag
+static unsigned ParseLevels(const char* txt)
+{
+	static const char* level_tags[llNone] = { "trc", "dbg", "inf", "wrn", "err", "flt" };
+	unsigned mask = 0;
+	while (*txt) {
+		const char* tag_end = std::strchr(txt, ',');
+		if (!tag_end) tag_end = txt + std::strlen(txt);
+		int lvl = 0;
+		for (; lvl < llNone; ++lvl) {
+			if (3 != tag_end - txt) continue;
+			int i = 0;
+			while (i < 3 && (txt[i] | 0x20) == level_tags[lvl][i]) ++i;
+			if (3 == i) break;
+		}
+		if (llNone == lvl) return 0;
+		mask |= LogLvlMask((LogLevel)lvl);
+		txt = *tag_end ? tag_end + 1 : tag_end;
+	}
+	return mask;
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t from_key = 0, to_key = UINT64_MAX;
+	unsigned level_mask = LogLvlMaskAll;
+	bool count_only = false, build_index = false;
+	size_t index_step = LogIndexStepDefault;
+	bool is_valid = argc >= 2;
+	for (int i = 2; i < argc && is_valid; ++i) {
+		bool has_value = i + 1 < argc;
+		if (0 == std::strcmp(argv[i], "-from") && has_value) is_valid = 0 != (from_key = LogTimeKeyParse(argv[++i], false));
+		else if (0 == std::strcmp(argv[i], "-to") && has_value) is_valid = 0 != (to_key = LogTimeKeyParse(argv[++i], true));
+		else if (0 == std::strcmp(argv[i], "-l") && has_value) is_valid = 0 != (level_mask = ParseLevels(argv[++i]));
+		else if (0 == std::strcmp(argv[i], "-c")) count_only = true;
+		else if (0 == std::strcmp(argv[i], "-i")) {
+			build_index = true;
+			if (has_value && std::atoi(argv[i + 1]) > 0) index_step = (size_t)std::atoi(argv[++i]) * 1024;
+		} else is_valid = false;
+	}
+	if (!is_valid) {
+		std::fprintf(stderr, "Usage: %s <log file> [-from <time>] [-to <time>] [-l <levels>] [-c] [-i [<step KiB>]]\n"
+			"  time: YYYY-MM-DD[ HH[:MM[:SS[.mmm]]]], levels: trc,dbg,inf,wrn,err,flt\n", argv[0]);
+		return 1;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	LogFileReader reader;
+	if (!reader.Open((FILE_PATH_CHAR*)LisStr::CStrConvert(argv[1]))) {
+		std::fprintf(stderr, "Can't read log file: %s\n", argv[1]);
+		return 2;
+	}
+	std::string index_path = std::string(argv[1]) + ".idx";
+	if (build_index) {
+		reader.BuildIndex(index_step);
+		if (!reader.SaveIndex((FILE_PATH_CHAR*)LisStr::CStrConvert(index_path.c_str())))
+			std::fprintf(stderr, "Can't write index file: %s\n", index_path.c_str());
+	} else reader.LoadIndex((FILE_PATH_CHAR*)LisStr::CStrConvert(index_path.c_str())); // optional
+
+	long long count = reader.Query(from_key, to_key, level_mask, [count_only](LogLevel /*lvl*/, const char* txt, size_t len) {
+		if (!count_only) std::fwrite(txt, 1, len, stdout);
+		return true;
+	});
+	if (count_only) {
+		double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		std::printf("%lld events, %.3f ms (index entries: %u)\n", count, elapsed_ms, (unsigned)reader.GetIndexSize());
+	}
+	return 0;
+}
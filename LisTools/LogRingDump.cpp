@@ -0,0 +1,31 @@
+// ****** Memory-mapped ring log dump tool. (c) 2025 LISV ******
+// Usage: LogRingDump <ring file> [-s]
+// Prints the events kept in the ring file (LogTargetMemRing) to stdout, the oldest first;
+// -s - prefix each event with its sequence number.
+#include <cstdio>
+#include <cstring>
+#include "../LisCommon/LogMemRing.h"
+#include "../LisCommon/StrUtils.h"
+
+using namespace LisLog;
+
+int main(int argc, char* argv[])
+{
+	bool print_sequence = (argc == 3) && (0 == std::strcmp(argv[2], "-s"));
+	if (argc != 2 && !print_sequence) {
+		std::fprintf(stderr, "Usage: %s <ring file> [-s]\n", argv[0]);
+		return 1;
+	}
+	long long count = LogMemRingRead((FILE_PATH_CHAR*)LisStr::CStrConvert(argv[1]),
+		[print_sequence](uint64_t sequence, const char* txt, size_t len) {
+			if (print_sequence) std::printf("%llu: ", (unsigned long long)sequence);
+			std::fwrite(txt, 1, len, stdout);
+			std::fputc('\n', stdout);
+			return true;
+		});
+	if (count < 0) {
+		std::fprintf(stderr, "Can't read ring file: %s\n", argv[1]);
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+// ****** Logger benchmark tool. (c) 2025 LISV ******
+// Usage: LoggerBench [-t <max threads>] [-n <calls per thread>] [-a] [-d <log directory>]
+//                    [-csv <file>] [-json <file>]
+// Measures the log calls (LogTxt, LogFmt, LogHex and the call filtered out by the level) against
+// the null, LogTargetTextFunc and LogTargetTextFile targets from 1, 2, 4 .. max threads.
+// Reports per call latency percentiles (the clock reading cost is included) and messages/s;
+// -a - the logger async mode, -d - directory for the text file target (default: ./LoggerBench, the files
+// "bench_*" are deleted before every run).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../LisCommon/FileSystem.h"
+#include "../LisCommon/Logger.h"
+#include "../LisCommon/StrUtils.h"
+
+using namespace LisLog;
+
+// Discards the events (measures the logger itself)
+class LogTargetNull : public LogTargetBase
+{
+protected:
+	virtual void WriteEvent(const LogEvent& /*evt*/) override { }
+public:
+	LogTargetNull(LogLevel lvl = llInfo) : LogTargetBase(lvl) { }
+};
+
+enum BenchCall { bcTxt, bcFmt, bcHex, bcFiltered, bcCount };
+const char* BenchCallName[bcCount] = { "LogTxt", "LogFmt", "LogHex", "Filtered" };
+enum BenchTarget { btNull, btFunc, btFile, btCount };
+const char* BenchTargetName[btCount] = { "null", "TextFunc", "TextFile" };
+const FILE_PATH_CHAR BenchLogPrefix[] = FILE_PATH_TEXT("bench_");
+
+struct BenchResult
+{
+	BenchTarget Target;
+	BenchCall Call;
+	unsigned Threads;
+	double P50, P99, P999, Max; // ns
+	double MsgPerSec;
+};
+
+static void BenchThreadProc(ILogger* logger, BenchCall call, unsigned count, std::vector<uint32_t>& samples)
+{
+	unsigned char hex_data[0x40];
+	for (size_t i = 0; i < sizeof(hex_data); ++i) hex_data[i] = (unsigned char)i;
+	samples.resize(count);
+	for (unsigned i = 0; i < count; ++i) {
+		auto t0 = std::chrono::steady_clock::now();
+		switch (call) {
+		case bcTxt: logger->LogTxt(llInfo, "Benchmark message text of the typical length"); break;
+		case bcFmt: logger->LogFmt(llInfo, "Benchmark message %u: %s = %.3f", i, "value", i * 0.5); break;
+		case bcHex: logger->LogHex(llInfo, "Benchmark data", hex_data, sizeof(hex_data)); break;
+		default: logger->LogFmt(llDebug, "Filtered message %u", i); // below the targets level
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		samples[i] = (uint32_t)std::min<long long>(UINT32_MAX,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+	}
+}
+
+// Deletes the log files of the previous runs: the text file target appends to the day file
+static void BenchLogsClear(const std::string& log_dir)
+{
+	const std::basic_string<FILE_PATH_CHAR> prefix(BenchLogPrefix);
+	std::basic_string<FILE_PATH_CHAR> dir_path((FILE_PATH_CHAR*)LisStr::CStrConvert(log_dir.c_str()));
+	if (!dir_path.empty() && FILE_PATH_SEPARATOR_CHR != dir_path.back()) dir_path += FILE_PATH_SEPARATOR_CHR;
+	std::vector<std::basic_string<FILE_PATH_CHAR>> files;
+	LisFileSys::DirEnum([&](const LisFileSys::FileEntry& file) {
+		size_t name_pos = file.Path.find_last_of(FILE_PATH_SEPARATOR_CHR);
+		name_pos = (std::string::npos == name_pos) ? 0 : name_pos + 1;
+		if (0 == file.Path.compare(name_pos, prefix.length(), prefix)) files.push_back(file.Path);
+		return true;
+	}, dir_path.c_str());
+	for (const auto& path : files) LisFileSys::FileDelete(path.c_str());
+}
+
+static BenchResult BenchRun(BenchTarget target, BenchCall call, unsigned threads, unsigned count,
+	const LoggerSettings& settings, const std::string& log_dir)
+{
+	LogTargetBase* log_target;
+	switch (target) {
+	case btNull: log_target = new LogTargetNull(); break;
+	case btFunc: log_target = new LogTargetTextFunc([](LogTargetBase::EventType /*type*/, const char* txt) {
+			static thread_local volatile size_t sink;
+			sink += std::strlen(txt);
+		}); break;
+	default:
+		BenchLogsClear(log_dir);
+		log_target = new LogTargetTextFile((FILE_PATH_CHAR*)LisStr::CStrConvert(log_dir.c_str()),
+			BenchLogPrefix, llInfo, lfpBytes, LogFileBufferSize);
+	}
+	LogTargetBase* targets[] = { log_target };
+	Logger::InitSingleton(settings, targets, 1);
+	ILogger* logger = Logger::GetInstance();
+
+	std::vector<std::vector<uint32_t>> samples(threads);
+	std::vector<std::thread> workers;
+	auto t0 = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < threads; ++i)
+		workers.emplace_back(BenchThreadProc, logger, call, count, std::ref(samples[i]));
+	for (auto& worker : workers) worker.join();
+	logger->Flush(); // the sustained rate includes writing out the queued and buffered events
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	Logger::InitSingleton(LoggerSettings(), nullptr, 0);
+
+	std::vector<uint32_t> all;
+	all.reserve((size_t)threads * count);
+	for (const auto& thread_samples : samples) all.insert(all.end(), thread_samples.begin(), thread_samples.end());
+	std::sort(all.begin(), all.end());
+	auto percentile = [&all](double p) { return (double)all[std::min(all.size() - 1, (size_t)(all.size() * p))]; };
+	BenchResult result;
+	result.Target = target;
+	result.Call = call;
+	result.Threads = threads;
+	result.P50 = percentile(0.5);
+	result.P99 = percentile(0.99);
+	result.P999 = percentile(0.999);
+	result.Max = all.back();
+	result.MsgPerSec = all.size() / elapsed;
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned max_threads = 4, count = 100000;
+	LoggerSettings settings;
+	std::string log_dir, csv_path, json_path;
+	for (int i = 1; i < argc; ++i) {
+		bool has_value = i + 1 < argc;
+		if (0 == std::strcmp(argv[i], "-t") && has_value) max_threads = std::max(1, std::atoi(argv[++i]));
+		else if (0 == std::strcmp(argv[i], "-n") && has_value) count = std::max(1, std::atoi(argv[++i]));
+		else if (0 == std::strcmp(argv[i], "-a")) settings.AsyncMode = true;
+		else if (0 == std::strcmp(argv[i], "-d") && has_value) log_dir = argv[++i];
+		else if (0 == std::strcmp(argv[i], "-csv") && has_value) csv_path = argv[++i];
+		else if (0 == std::strcmp(argv[i], "-json") && has_value) json_path = argv[++i];
+		else {
+			std::fprintf(stderr, "Usage: %s [-t <max threads>] [-n <calls per thread>] [-a] [-d <log directory>]"
+				" [-csv <file>] [-json <file>]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (log_dir.empty()) log_dir = "LoggerBench";
+	std::vector<unsigned> thread_counts; // 1, 2, 4 .. max_threads
+	for (unsigned threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+	thread_counts.push_back(max_threads);
+
+	std::vector<BenchResult> results;
+	std::printf("%-9s %-9s %7s %10s %10s %10s %10s %12s\n",
+		"target", "call", "threads", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "msg/s");
+	for (int target = 0; target < btCount; ++target) {
+		for (int call = 0; call < bcCount; ++call) {
+			for (unsigned threads : thread_counts) {
+				BenchResult res = BenchRun((BenchTarget)target, (BenchCall)call, threads, count, settings, log_dir);
+				std::printf("%-9s %-9s %7u %10.0f %10.0f %10.0f %10.0f %12.0f\n", BenchTargetName[res.Target],
+					BenchCallName[res.Call], res.Threads, res.P50, res.P99, res.P999, res.Max, res.MsgPerSec);
+				std::fflush(stdout);
+				results.push_back(res);
+			}
+		}
+	}
+
+	if (!csv_path.empty()) {
+		FILE* file = std::fopen(csv_path.c_str(), "w");
+		if (!file) {
+			std::fprintf(stderr, "Can't write: %s\n", csv_path.c_str());
+			return 2;
+		}
+		std::fprintf(file, "target,call,threads,async,p50_ns,p99_ns,p999_ns,max_ns,msg_per_sec\n");
+		for (const auto& res : results)
+			std::fprintf(file, "%s,%s,%u,%d,%.0f,%.0f,%.0f,%.0f,%.0f\n", BenchTargetName[res.Target], BenchCallName[res.Call],
+				res.Threads, settings.AsyncMode ? 1 : 0, res.P50, res.P99, res.P999, res.Max, res.MsgPerSec);
+		std::fclose(file);
+	}
+	if (!json_path.empty()) {
+		FILE* file = std::fopen(json_path.c_str(), "w");
+		if (!file) {
+			std::fprintf(stderr, "Can't write: %s\n", json_path.c_str());
+			return 2;
+		}
+		std::fprintf(file, "[\n");
+		for (size_t i = 0; i < results.size(); ++i) {
+			const auto& res = results[i];
+			std::fprintf(file, "  {\"target\": \"%s\", \"call\": \"%s\", \"threads\": %u, \"async\": %s, "
+				"\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f, \"msg_per_sec\": %.0f}%s\n",
+				BenchTargetName[res.Target], BenchCallName[res.Call], res.Threads, settings.AsyncMode ? "true" : "false",
+				res.P50, res.P99, res.P999, res.Max, res.MsgPerSec, (i + 1 < results.size()) ? "," : "");
+		}
+		std::fprintf(file, "]\n");
+		std::fclose(file);
+	}
+	return 0;
+}